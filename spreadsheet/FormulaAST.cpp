@@ -7,6 +7,7 @@
 #include <cassert>
 #include <cctype>
 #include <cmath>
+#include <cstddef>
 #include <memory>
 #include <optional>
 #include <sstream>
@@ -68,270 +69,154 @@ constexpr PrecedenceRule PRECEDENCE_RULES[EP_END][EP_END] = {
     /* EP_ATOM */ {PR_NONE, PR_NONE, PR_NONE, PR_NONE, PR_NONE, PR_NONE},
 };
 
-class Expr {
-public:
-    virtual ~Expr() = default;
-    virtual void Print(std::ostream& out) const = 0;
-    virtual void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const = 0;
-    virtual double Evaluate(const SheetInterface& sheet) const = 0;
-
-    // higher is tighter
-    virtual ExprPrecedence GetPrecedence() const = 0;
-
-    void PrintFormula(std::ostream& out, ExprPrecedence parent_precedence,
-                      bool right_child = false) const {
-        auto precedence = GetPrecedence();
-        auto mask = right_child ? PR_RIGHT : PR_LEFT;
-        bool parens_needed = PRECEDENCE_RULES[parent_precedence][precedence] & mask;
-        if (parens_needed) {
-            out << '(';
-        }
+namespace {
+ExprPrecedence GetPrecedence(const Node& node) {
+    switch (node.kind) {
+        case NodeKind::UnaryOp:
+            return EP_UNARY;
+        case NodeKind::BinaryOp:
+            switch (node.op) {
+                case '+':
+                    return EP_ADD;
+                case '-':
+                    return EP_SUB;
+                case '*':
+                    return EP_MUL;
+                default:
+                    assert(node.op == '/');
+                    return EP_DIV;
+            }
+        default:
+            return EP_ATOM;
+    }
+}
 
-        DoPrintFormula(out, precedence);
+void PrintAtom(std::ostream& out, const Node& node) {
+    if (node.kind == NodeKind::Number) {
+        out << node.value.number;
+    } else if (!node.value.cell.IsValid()) {
+        out << FormulaError{FormulaError::Category::Ref};
+    } else {
+        out << node.value.cell.ToString();
+    }
+}
 
-        if (parens_needed) {
+// prints the subtree rooted at nodes[root] in prefix notation
+void Print(std::ostream& out, const Node* nodes, std::uint32_t root) {
+    const Node& node = nodes[root];
+    switch (node.kind) {
+        case NodeKind::UnaryOp:
+            out << '(' << node.op << ' ';
+            Print(out, nodes, root - 1);
             out << ')';
-        }
+            break;
+        case NodeKind::BinaryOp:
+            out << '(' << node.op << ' ';
+            Print(out, nodes, node.lhs);
+            out << ' ';
+            Print(out, nodes, root - 1);
+            out << ')';
+            break;
+        default:
+            PrintAtom(out, node);
     }
-};
-
-namespace {
-class BinaryOpExpr final : public Expr {
-public:
-    enum Type : char {
-        Add = '+',
-        Subtract = '-',
-        Multiply = '*',
-        Divide = '/',
-    };
+}
 
-public:
-    explicit BinaryOpExpr(Type type, std::unique_ptr<Expr> lhs, std::unique_ptr<Expr> rhs)
-        : type_(type)
-        , lhs_(std::move(lhs))
-        , rhs_(std::move(rhs)) {
+void PrintFormula(std::ostream& out, const Node* nodes, std::uint32_t root,
+                  ExprPrecedence parent_precedence, bool right_child = false) {
+    const Node& node = nodes[root];
+    auto precedence = GetPrecedence(node);
+    auto mask = right_child ? PR_RIGHT : PR_LEFT;
+    bool parens_needed = PRECEDENCE_RULES[parent_precedence][precedence] & mask;
+    if (parens_needed) {
+        out << '(';
     }
 
-    void Print(std::ostream& out) const override {
-        out << '(' << static_cast<char>(type_) << ' ';
-        lhs_->Print(out);
-        out << ' ';
-        rhs_->Print(out);
-        out << ')';
+    switch (node.kind) {
+        case NodeKind::UnaryOp:
+            out << node.op;
+            PrintFormula(out, nodes, root - 1, precedence);
+            break;
+        case NodeKind::BinaryOp:
+            PrintFormula(out, nodes, node.lhs, precedence);
+            out << node.op;
+            PrintFormula(out, nodes, root - 1, precedence, /* right_child = */ true);
+            break;
+        default:
+            PrintAtom(out, node);
     }
 
-    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const override {
-        lhs_->PrintFormula(out, precedence);
-        out << static_cast<char>(type_);
-        rhs_->PrintFormula(out, precedence, /* right_child = */ true);
+    if (parens_needed) {
+        out << ')';
     }
+}
 
-    ExprPrecedence GetPrecedence() const override {
-        switch (type_) {
-            case Add:
-                return EP_ADD;
-            case Subtract:
-                return EP_SUB;
-            case Multiply:
-                return EP_MUL;
-            case Divide:
-                return EP_DIV;
-            default:
-                // have to do this because VC++ has a buggy warning
-                assert(false);
-                return static_cast<ExprPrecedence>(INT_MAX);
-        }
+FormulaProgram::OpCode GetBinaryOpCode(char op) {
+    using OpCode = FormulaProgram::OpCode;
+    switch (op) {
+        case '+':
+            return OpCode::Add;
+        case '-':
+            return OpCode::Subtract;
+        case '*':
+            return OpCode::Multiply;
+        default:
+            assert(op == '/');
+            return OpCode::Divide;
     }
+}
 
-    double Evaluate(const SheetInterface& sheet) const override {
-        const double lhs = lhs_->Evaluate(sheet);
-        const double rhs = rhs_->Evaluate(sheet);
-        double res;
-        switch (type_) {
-            case Divide: {
-                res =  lhs / rhs;
+// the postfix order of the nodes is the order of the code
+void Compile(const std::pmr::vector<Node>& nodes, FormulaCompiler& program) {
+    for (const Node& node : nodes) {
+        switch (node.kind) {
+            case NodeKind::Number:
+                program.PushConst(node.value.number);
                 break;
-            }
-            case Multiply: {
-                res = lhs * rhs;
+            case NodeKind::Cell:
+                program.LoadCell(node.value.cell);
                 break;
-            }
-            case Subtract: {
-                res = lhs - rhs;
+            case NodeKind::UnaryOp:
+                if (node.op == '-') {
+                    program.Emit(FormulaProgram::OpCode::Negate);
+                }
                 break;
-            }
-            case Add: {
-                res = lhs + rhs;
+            case NodeKind::BinaryOp:
+                program.Emit(GetBinaryOpCode(node.op));
                 break;
-            }
-            default:
-                assert(false);
-                return static_cast<ExprPrecedence>(INT_MAX);
         }
-        if (!std::isfinite(res)) {
-            throw FormulaError(FormulaError::Category::Arithmetic);
-        }
-        return res;
     }
-
-private:
-    Type type_;
-    std::unique_ptr<Expr> lhs_;
-    std::unique_ptr<Expr> rhs_;
-};
-
-class UnaryOpExpr final : public Expr {
-public:
-    enum Type : char {
-        UnaryPlus = '+',
-        UnaryMinus = '-',
-    };
-
-public:
-    explicit UnaryOpExpr(Type type, std::unique_ptr<Expr> operand)
-        : type_(type)
-        , operand_(std::move(operand)) {
-    }
-
-    void Print(std::ostream& out) const override {
-        out << '(' << static_cast<char>(type_) << ' ';
-        operand_->Print(out);
-        out << ')';
-    }
-
-    void DoPrintFormula(std::ostream& out, ExprPrecedence precedence) const override {
-        out << static_cast<char>(type_);
-        operand_->PrintFormula(out, precedence);
-    }
-
-    ExprPrecedence GetPrecedence() const override {
-        return EP_UNARY;
-    }
-
-    double Evaluate(const SheetInterface& sheet) const override {
-        return (type_ == UnaryMinus ? -1 : 1) * operand_->Evaluate(sheet);
-    }
-
-private:
-    Type type_;
-    std::unique_ptr<Expr> operand_;
-};
-
-class CellExpr final : public Expr {
-public:
-    explicit CellExpr(const Position* cell)
-        : cell_(cell) {
-    }
-
-    void Print(std::ostream& out) const override {
-        if (!cell_->IsValid()) {
-            out << FormulaError{FormulaError::Category::Ref};
-        } else {
-            out << cell_->ToString();
-        }
-    }
-
-    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */) const override {
-        Print(out);
-    }
-
-    ExprPrecedence GetPrecedence() const override {
-        return EP_ATOM;
-    }
-
-    double Evaluate(const SheetInterface& sheet) const override {
-        auto is_number = [] (const std::string& s) {
-            return !s.empty() && std::find_if(s.begin(), 
-                s.end(), [](unsigned char c) { return !std::isdigit(c); }) == s.end();
-        };
-        
-        if (!cell_->IsValid()) {
-            throw FormulaException("Invalid position exc");
-        }
-        /* all cells exists in sheet due to Cell::Set method */
-        const CellInterface* cell_ptr = sheet.GetCell(*cell_);
-        if (cell_ptr == nullptr) {
-            return double(0);
-        }
-        CellInterface::Value val = cell_ptr->GetValue();
-        
-        if (std::holds_alternative<double>(val)) {
-            return std::get<double>(val);
-
-        } else if (std::holds_alternative<std::string>(val)) {
-            std::string s{std::get<std::string>(val)};
-            if (s.empty()) {
-                return double(0);
-            } else if (!is_number(s)) {
-                throw FormulaError{FormulaError::Category::Value};
-            }
-            return stod(s);
-
-        } else {
-            throw std::get<FormulaError>(val);
-        }
-    }
-
-private:
-    const Position* cell_;
-};
-
-class NumberExpr final : public Expr {
-public:
-    explicit NumberExpr(double value)
-        : value_(value) {
-    }
-
-    void Print(std::ostream& out) const override {
-        out << value_;
-    }
-
-    void DoPrintFormula(std::ostream& out, ExprPrecedence /* precedence */) const override {
-        out << value_;
-    }
-
-    ExprPrecedence GetPrecedence() const override {
-        return EP_ATOM;
-    }
-
-    double Evaluate(const SheetInterface& sheet) const override {
-        return value_;
-    }
-
-private:
-    double value_;
-};
+}
 
 class ParseASTListener final : public FormulaBaseListener {
 public:
-    std::unique_ptr<Expr> MoveRoot() {
-        assert(args_.size() == 1);
-        auto root = std::move(args_.front());
-        args_.clear();
-
-        return root;
+    // appends the nodes in postfix order, the operand stack is allocated
+    // from the scratch resource too
+    ParseASTListener(std::pmr::vector<Node>& nodes, std::pmr::memory_resource* scratch)
+        : nodes_(nodes)
+        , args_(scratch) {
     }
 
-    std::forward_list<Position> MoveCells() {
-        return std::move(cells_);
+    void Finish() {
+        assert(args_.size() == 1 && args_.front() == nodes_.size() - 1);
+        args_.clear();
     }
 
 public:
     void exitUnaryOp(FormulaParser::UnaryOpContext* ctx) override {
         assert(args_.size() >= 1);
 
-        auto operand = std::move(args_.back());
-
-        UnaryOpExpr::Type type;
+        Node node;
+        node.kind = NodeKind::UnaryOp;
         if (ctx->SUB()) {
-            type = UnaryOpExpr::UnaryMinus;
+            node.op = '-';
         } else {
             assert(ctx->ADD() != nullptr);
-            type = UnaryOpExpr::UnaryPlus;
+            node.op = '+';
         }
+        node.lhs = 0;
 
-        auto node = std::make_unique<UnaryOpExpr>(type, std::move(operand));
-        args_.back() = std::move(node);
+        args_.back() = Append(node);
     }
 
     void exitLiteral(FormulaParser::LiteralContext* ctx) override {
@@ -343,8 +228,12 @@ public:
             throw ParsingError("Invalid number: " + valueStr);
         }
 
-        auto node = std::make_unique<NumberExpr>(value);
-        args_.push_back(std::move(node));
+        Node node;
+        node.kind = NodeKind::Number;
+        node.op = 0;
+        node.lhs = 0;
+        node.value.number = value;
+        args_.push_back(Append(node));
     }
 
     void exitCell(FormulaParser::CellContext* ctx) override {
@@ -354,33 +243,34 @@ public:
             throw FormulaException("Invalid position: " + value_str);
         }
 
-        cells_.push_front(value);
-        auto node = std::make_unique<CellExpr>(&cells_.front());
-        args_.push_back(std::move(node));
+        Node node;
+        node.kind = NodeKind::Cell;
+        node.op = 0;
+        node.lhs = 0;
+        node.value.cell = value;
+        args_.push_back(Append(node));
     }
 
     void exitBinaryOp(FormulaParser::BinaryOpContext* ctx) override {
         assert(args_.size() >= 2);
 
-        auto rhs = std::move(args_.back());
-        args_.pop_back();
+        args_.pop_back();  // the right operand is the last node
 
-        auto lhs = std::move(args_.back());
-
-        BinaryOpExpr::Type type;
+        Node node;
+        node.kind = NodeKind::BinaryOp;
         if (ctx->ADD()) {
-            type = BinaryOpExpr::Add;
+            node.op = '+';
         } else if (ctx->SUB()) {
-            type = BinaryOpExpr::Subtract;
+            node.op = '-';
         } else if (ctx->MUL()) {
-            type = BinaryOpExpr::Multiply;
+            node.op = '*';
         } else {
             assert(ctx->DIV() != nullptr);
-            type = BinaryOpExpr::Divide;
+            node.op = '/';
         }
+        node.lhs = args_.back();
 
-        auto node = std::make_unique<BinaryOpExpr>(type, std::move(lhs), std::move(rhs));
-        args_.back() = std::move(node);
+        args_.back() = Append(node);
     }
 
     void visitErrorNode(antlr4::tree::ErrorNode* node) override {
@@ -388,8 +278,14 @@ public:
     }
 
 private:
-    std::vector<std::unique_ptr<Expr>> args_;
-    std::forward_list<Position> cells_;
+    std::uint32_t Append(const Node& node) {
+        nodes_.push_back(node);
+        return static_cast<std::uint32_t>(nodes_.size() - 1);
+    }
+
+    std::pmr::vector<Node>& nodes_;
+    // the roots of the operands yet without an operator
+    std::pmr::vector<std::uint32_t> args_;
 };
 
 class BailErrorListener : public antlr4::BaseErrorListener {
@@ -405,7 +301,8 @@ public:
 }  // namespace
 }  // namespace ASTImpl
 
-FormulaAST ParseFormulaAST(std::istream& in) {
+void ParseFormulaAST(std::istream& in, FormulaDraft& draft) {
+    assert(draft.nodes_.empty());
     using namespace antlr4;
 
     ANTLRInputStream input(in);
@@ -423,49 +320,69 @@ FormulaAST ParseFormulaAST(std::istream& in) {
     parser.removeErrorListeners();
 
     tree::ParseTree* tree = parser.main();
-    ASTImpl::ParseASTListener listener;
+    ASTImpl::ParseASTListener listener(draft.nodes_, &draft.scratch_);
     tree::ParseTreeWalker::DEFAULT.walk(&listener, tree);
+    listener.Finish();
 
-
-    return FormulaAST(listener.MoveRoot(), listener.MoveCells());
+    ASTImpl::Compile(draft.nodes_, draft.compiler_);
+    draft.compiler_.Finish();
 }
 
-FormulaAST ParseFormulaAST(const std::string& in_str) {
+void ParseFormulaAST(const std::string& in_str, FormulaDraft& draft) {
     std::istringstream in(in_str);
-    return ParseFormulaAST(in);
+    ParseFormulaAST(in, draft);
+}
+
+FormulaDraft::FormulaDraft()
+    : scratch_(scratch_buffer_, sizeof(scratch_buffer_))
+    , nodes_(&scratch_)
+    , compiler_(&scratch_) {
+}
+
+size_t FormulaDraft::GetStorageSize() const {
+    // a node is 16 bytes, so the program after the nodes stays aligned
+    static_assert(sizeof(ASTImpl::Node) % alignof(std::max_align_t) == 0);
+    return nodes_.size() * sizeof(ASTImpl::Node) + compiler_.GetStorageSize();
+}
+
+FormulaAST FormulaDraft::Place(std::byte* storage) const {
+    assert(!nodes_.empty());
+    auto nodes = reinterpret_cast<ASTImpl::Node*>(storage);
+    std::uninitialized_copy(nodes_.begin(), nodes_.end(), nodes);
+
+    FormulaAST ast;
+    ast.nodes_ = nodes;
+    ast.node_count_ = static_cast<std::uint32_t>(nodes_.size());
+    ast.program_ = compiler_.Place(storage + nodes_.size() * sizeof(ASTImpl::Node));
+    return ast;
 }
 
 void FormulaAST::PrintCells(std::ostream& out) const {
-    for (auto cell : cells_) {
-        out << cell.ToString() << ' ';
+    for (const Position* cell = CellsBegin(); cell != CellsEnd(); ++cell) {
+        out << cell->ToString() << ' ';
     }
 }
 
 void FormulaAST::Print(std::ostream& out) const {
-    root_expr_->Print(out);
+    ASTImpl::Print(out, nodes_, node_count_ - 1);
 }
 
 void FormulaAST::PrintFormula(std::ostream& out) const {
-    root_expr_->PrintFormula(out, ASTImpl::EP_ATOM);
+    ASTImpl::PrintFormula(out, nodes_, node_count_ - 1, ASTImpl::EP_ATOM);
 }
 
-double FormulaAST::Execute(const SheetInterface& sheet) const {
-    return root_expr_->Evaluate(sheet);
+std::variant<double, FormulaError> FormulaAST::Execute(const SheetInterface& sheet) const {
+    return program_.Execute(sheet);
 }
 
-std::forward_list<Position>& FormulaAST::GetCells() {
-    return cells_;
+void FormulaAST::BindCell(Position pos, const CellInterface* cell) {
+    program_.BindCell(pos, cell);
 }
 
-const std::forward_list<Position>& FormulaAST::GetCells() const {
-    return cells_;
+const Position* FormulaAST::CellsBegin() const {
+    return program_.CellsBegin();
 }
 
-FormulaAST::FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr
-                                , std::forward_list<Position> cells)
-    : root_expr_(std::move(root_expr))
-    , cells_(std::move(cells)) {
-    cells_.sort();  // to avoid sorting in GetReferencedCells
+const Position* FormulaAST::CellsEnd() const {
+    return program_.CellsEnd();
 }
-
-FormulaAST::~FormulaAST() = default;
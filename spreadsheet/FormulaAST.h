@@ -2,37 +2,93 @@
 
 #include "FormulaLexer.h"
 #include "common.h"
+#include "formula_program.h"
 
-#include <forward_list>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
 #include <stdexcept>
+#include <variant>
+#include <vector>
 
 namespace ASTImpl {
-class Expr;
+enum class NodeKind : std::uint8_t {
+    Number,
+    Cell,
+    UnaryOp,
+    BinaryOp,
+};
+
+// A node of the tree in an array of the nodes in postfix order, so the root
+// is the last one. The only operand of an unary operator and the right
+// operand of a binary one end just before the node, the left operand of a
+// binary operator ends at lhs. A node is 16 bytes.
+struct Node {
+    NodeKind kind;
+    char op;  // '+', '-', '*' or '/' of an operator
+    std::uint32_t lhs;
+    union Value {
+        Value() : number(0) {
+        }
+
+        double number;
+        Position cell;
+    } value;
+};
+static_assert(sizeof(Node) == 16);
 }
 
 class ParsingError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+// The AST of a formula: its nodes in postfix order and its compiled program.
+// It refers to the storage it was placed into by FormulaDraft::Place, the
+// storage is owned by the formula.
 class FormulaAST {
 public:
-    explicit FormulaAST(std::unique_ptr<ASTImpl::Expr> root_expr, std::forward_list<Position> cells);
-    FormulaAST(FormulaAST&&) = default;
-    FormulaAST& operator=(FormulaAST&&) = default;
-    ~FormulaAST();
-
-    double Execute(const SheetInterface& sheet) const;
+    std::variant<double, FormulaError> Execute(const SheetInterface& sheet) const;
+    void BindCell(Position pos, const CellInterface* cell);
     void Print(std::ostream& out) const;
     void PrintFormula(std::ostream& out) const;
     void PrintCells(std::ostream& out) const;
 
-    std::forward_list<Position>& GetCells();
-    const std::forward_list<Position>& GetCells() const;
+    // sorted, without repeats
+    const Position* CellsBegin() const;
+    const Position* CellsEnd() const;
 private:
-    std::unique_ptr<ASTImpl::Expr> root_expr_;
-    std::forward_list<Position> cells_;
+    friend class FormulaDraft;
+
+    // the tree is kept for printing, Execute runs the compiled program
+    const ASTImpl::Node* nodes_ = nullptr;
+    std::uint32_t node_count_ = 0;
+    FormulaProgram program_;
+};
+
+// A formula parsed and compiled in scratch memory, which is an inline buffer
+// for most formulas. Place copies the result into storage of a known size,
+// so that a formula keeps its nodes, code, constants and referenced
+// positions in one block.
+class FormulaDraft {
+public:
+    FormulaDraft();
+    FormulaDraft(const FormulaDraft&) = delete;
+    FormulaDraft& operator=(const FormulaDraft&) = delete;
+
+    // the bytes Place needs, a multiple of alignof(std::max_align_t)
+    size_t GetStorageSize() const;
+    // copies the AST into storage aligned to alignof(std::max_align_t)
+    FormulaAST Place(std::byte* storage) const;
+
+private:
+    friend void ParseFormulaAST(std::istream& in, FormulaDraft& draft);
+
+    alignas(std::max_align_t) std::byte scratch_buffer_[2048];
+    std::pmr::monotonic_buffer_resource scratch_;
+    std::pmr::vector<ASTImpl::Node> nodes_;
+    FormulaCompiler compiler_;
 };
 
-FormulaAST ParseFormulaAST(std::istream& in);
-FormulaAST ParseFormulaAST(const std::string& in_str);
\ No newline at end of file
+// parses and compiles the formula into an empty draft
+void ParseFormulaAST(std::istream& in, FormulaDraft& draft);
+void ParseFormulaAST(const std::string& in_str, FormulaDraft& draft);
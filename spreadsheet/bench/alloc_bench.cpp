@@ -0,0 +1,141 @@
+// Heap allocations per sheet operation with the default memory resource and
+// with a per-sheet arena (SheetOptions::own_arena), and per read of text cells.
+
+#include "../common.h"
+#include "../formula.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+std::int64_t allocation_count = 0;
+}  // namespace
+
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    ++allocation_count;
+    const std::size_t alignment = static_cast<std::size_t>(align);
+    if (void* ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+constexpr int ROWS = 200'000;
+
+// runs fn(row) for every row and prints allocations per call
+template <typename Fn>
+void Count(std::string_view name, Fn fn) {
+    const std::int64_t before = allocation_count;
+    Measure(name, ROWS, [&] {
+        for (int row = 0; row < ROWS; ++row) {
+            fn(row);
+        }
+    });
+    std::cout << "    " << double(allocation_count - before) / ROWS << " allocations/op" << std::endl;
+}
+
+void Run(bool own_arena) {
+    std::cout << (own_arena ? "own arena" : "default resource") << std::endl;
+    const std::int64_t before = allocation_count;
+    {
+        auto sheet = CreateSheet(SheetOptions{CellStorageKind::Tiled, own_arena});
+        const std::string label = "a label long enough to leave the small string buffer";
+        Count("  set text", [&](int row) {
+            sheet->SetCell({row % Position::MAX_ROWS, row / Position::MAX_ROWS}, label);
+        });
+        Count("  set formula", [&](int row) {
+            sheet->SetCell({row % Position::MAX_ROWS, 20 + row / Position::MAX_ROWS}, "=1+2*3");
+        });
+        Count("  overwrite text", [&](int row) {
+            sheet->SetCell({row % Position::MAX_ROWS, row / Position::MAX_ROWS}, label);
+        });
+        Count("  clear", [&](int row) {
+            sheet->ClearCell({row % Position::MAX_ROWS, row / Position::MAX_ROWS});
+        });
+    }
+    std::cout << "  total " << allocation_count - before << " allocations" << std::endl;
+}
+
+// discards everything written into it
+class NullBuffer : public std::streambuf {
+protected:
+    int_type overflow(int_type ch) override {
+        return ch;
+    }
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+// reading text cells: values, printing and formulas over numeric text
+void RunReads() {
+    std::cout << "reads" << std::endl;
+    auto sheet = CreateSheet();
+    for (int row = 0; row < Position::MAX_ROWS; ++row) {
+        sheet->SetCell({row, 0}, std::to_string(row));
+        sheet->SetCell({row, 1}, "a label long enough to leave the small string buffer");
+    }
+    std::vector<std::unique_ptr<FormulaInterface>> formulas;
+    for (int row = 0; row < Position::MAX_ROWS; ++row) {
+        formulas.push_back(ParseFormula("A" + std::to_string(row + 1) + "*2"));
+    }
+
+    Count("  get value", [&](int row) {
+        sheet->GetCell({row % Position::MAX_ROWS, 1})->GetValue();
+    });
+    Count("  get value view", [&](int row) {
+        sheet->GetCell({row % Position::MAX_ROWS, 1})->GetValueView();
+    });
+    Count("  evaluate formula over text", [&](int row) {
+        formulas[row % Position::MAX_ROWS]->Evaluate(*sheet);
+    });
+    NullBuffer buffer;
+    std::ostream output(&buffer);
+    const std::int64_t before = allocation_count;
+    Measure("  print values", Position::MAX_ROWS, [&] {
+        sheet->PrintValues(output);
+    });
+    std::cout << "    " << double(allocation_count - before) / Position::MAX_ROWS
+              << " allocations/row" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    Run(false);
+    Run(true);
+    RunReads();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+// Runs fn once and prints the wall time and the time per operation.
+template <typename Fn>
+double Measure(std::string_view name, std::int64_t op_count, Fn&& fn) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    fn();
+    const std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << elapsed.count() << " ms"
+              << std::setw(14) << elapsed.count() * 1e6 / op_count << " ns/op" << std::endl;
+    return elapsed.count();
+}
@@ -0,0 +1,55 @@
+// Reads of referenced cells during Sheet::Recalculate: 1000 inputs in the
+// first row and 100K formulas below, each summing 16 inputs at random
+// positions. Every round edits all inputs, so every formula is evaluated
+// again. Reports the time per referenced cell read for both storages.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <random>
+#include <string>
+
+namespace {
+
+constexpr int INPUTS = 1000;
+constexpr int FORMULA_ROWS = 100;
+constexpr int REFS = 16;
+constexpr std::int64_t READS = std::int64_t{FORMULA_ROWS} * INPUTS * REFS;
+
+void Run(CellStorageKind kind, const char* name) {
+    Sheet sheet(SheetOptions{kind});
+    for (int col = 0; col < INPUTS; ++col) {
+        sheet.SetCell({0, col}, "1");
+    }
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> input(0, INPUTS - 1);
+    for (int row = 1; row <= FORMULA_ROWS; ++row) {
+        for (int col = 0; col < INPUTS; ++col) {
+            std::string text = "=";
+            for (int k = 0; k < REFS; ++k) {
+                text += (k > 0 ? "+" : "") + std::string(Position{0, input(gen)}.ToString());
+            }
+            sheet.SetCell({row, col}, text);
+        }
+    }
+    sheet.Recalculate();
+
+    for (int round = 2; round <= 4; ++round) {
+        for (int col = 0; col < INPUTS; ++col) {
+            sheet.SetCell({0, col}, std::to_string(round));
+        }
+        Measure(std::string(name) + ": recalculate", READS, [&] {
+            sheet.Recalculate();
+        });
+    }
+    std::cout << "    value " << std::get<double>(sheet.GetCell({FORMULA_ROWS, 0})->GetValue())
+              << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    Run(CellStorageKind::Tiled, "tiled");
+    Run(CellStorageKind::Hashed, "hashed");
+}
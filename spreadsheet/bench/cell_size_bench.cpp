@@ -0,0 +1,70 @@
+// Heap bytes per cell on a sheet of 1M cells, everything allocated through
+// the global operator new (tiles, cells, text, formulas, dependency graph).
+// For sheets with pooled texts it also prints what sharing them saved.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+#include "heap_counter.h"
+
+#include <string>
+
+namespace {
+
+constexpr int SIDE = 1000;
+constexpr std::int64_t CELL_COUNT = std::int64_t{SIDE} * SIDE;
+
+// fills a SIDE x SIDE block with text(pos) and prints the live heap bytes per cell
+template <typename TextFn>
+void Fill(std::string_view name, TextFn text) {
+    const std::int64_t before = live_bytes;
+    Sheet sheet;
+    Measure(name, CELL_COUNT, [&] {
+        for (int row = 0; row < SIDE; ++row) {
+            for (int col = 0; col < SIDE; ++col) {
+                sheet.SetCell({row, col}, text(Position{row, col}));
+            }
+        }
+    });
+    std::cout << "    " << double(live_bytes - before) / CELL_COUNT << " bytes/cell" << std::endl;
+    const SheetMemoryStats memory = sheet.GetMemoryStats();
+    std::cout << "    reported " << double(memory.GetTotal()) / CELL_COUNT << " bytes/cell: storage "
+              << double(memory.cell_storage) / CELL_COUNT << ", index " << double(memory.index) / CELL_COUNT
+              << ", texts " << double(memory.texts) / CELL_COUNT << ", formulas "
+              << double(memory.formulas) / CELL_COUNT << ", dependencies "
+              << double(memory.dependencies) / CELL_COUNT << std::endl;
+    const TextPool::Stats& stats = memory.text_pool;
+    if (stats.references > 0) {
+        const auto saved = static_cast<std::int64_t>(stats.referenced_bytes)
+                           - static_cast<std::int64_t>(stats.unique_bytes + stats.overhead_bytes);
+        std::cout << "    " << stats.unique_texts << " unique of " << stats.references
+                  << " pooled texts, interning saved " << double(saved) / CELL_COUNT << " bytes/cell"
+                  << std::endl;
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::cout << "sizeof(Cell) = " << sizeof(Cell) << std::endl;
+    Fill("short text", [](Position pos) {
+        return "item " + std::to_string(pos.row);
+    });
+    Fill("long text", [](Position pos) {
+        return "a label long enough to leave the small string buffer " + std::to_string(pos.row);
+    });
+    // a hundred distinct category names repeated over the sheet
+    Fill("repeated labels", [](Position pos) {
+        return "category name number " + std::to_string((pos.row * SIDE + pos.col) % 100);
+    });
+    Fill("numbers", [](Position pos) {
+        return std::to_string(pos.row * SIDE + pos.col);
+    });
+    // every cell but the first column refers to the first cell of its row
+    Fill("formulas", [](Position pos) -> std::string {
+        if (pos.col == 0) {
+            return "1";
+        }
+        return "=" + Position{pos.row, 0}.ToString() + "+1";
+    });
+}
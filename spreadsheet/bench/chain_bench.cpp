@@ -0,0 +1,43 @@
+// Running-balance chains: cell k is "=<cell k-1>+1". Measures the first
+// read of the last cell, which evaluates the whole chain, and a read after
+// an edit of the head.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+Position At(int k) {
+    return {k % Position::MAX_ROWS, k / Position::MAX_ROWS};
+}
+
+void Run(int length) {
+    Sheet sheet;
+    // from the end, so that the cycle checks see no formulas
+    Measure("chain of " + std::to_string(length) + ", build", length, [&] {
+        for (int k = length - 1; k > 0; --k) {
+            sheet.SetCell(At(k), "=" + At(k - 1).ToString() + "+1");
+        }
+        sheet.SetCell(At(0), "1");
+    });
+    const CellInterface* last = sheet.GetCell(At(length - 1));
+    Measure("chain of " + std::to_string(length) + ", first read", length, [&] {
+        last->GetValue();
+    });
+    Measure("chain of " + std::to_string(length) + ", edit head and read", length, [&] {
+        sheet.SetCell(At(0), "2");
+        last->GetValue();
+    });
+    std::cout << "    value " << std::get<double>(last->GetValue()) << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    for (int length : {250'000, 500'000, 1'000'000, 2'000'000}) {
+        Run(length);
+    }
+}
@@ -0,0 +1,44 @@
+// Memory under formula churn: one cell is rewritten again and again with a
+// formula over a range of positions nobody has set, every rewrite moves the
+// range. Ends with the cell set to plain text.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+#include "heap_counter.h"
+
+#include <string>
+
+namespace {
+
+constexpr int REWRITES = 2000;
+constexpr int REFS_PER_FORMULA = 50;
+
+void Report(const Sheet& sheet, std::int64_t before) {
+    const SheetMemoryStats stats = sheet.GetMemoryStats();
+    std::cout << "    " << stats.cell_count << " cells, " << (live_bytes - before) / 1024
+              << " KiB live" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    const std::int64_t before = live_bytes;
+    Sheet sheet;
+    for (int rewrite = 0; rewrite < REWRITES; ++rewrite) {
+        const int col = 1 + rewrite % 1000;
+        const int first_row = rewrite / 1000 * REFS_PER_FORMULA;
+        std::string formula = "=";
+        for (int row = first_row; row < first_row + REFS_PER_FORMULA; ++row) {
+            formula += (row == first_row ? "" : "+") + Position{row, col}.ToString();
+        }
+        sheet.SetCell({0, 0}, formula);
+        if ((rewrite + 1) % 500 == 0) {
+            std::cout << "after " << rewrite + 1 << " rewrites" << std::endl;
+            Report(sheet, before);
+        }
+    }
+    sheet.SetCell({0, 0}, "plain text");
+    std::cout << "after setting text" << std::endl;
+    Report(sheet, before);
+}
@@ -0,0 +1,54 @@
+// Early cutoff on 1000 rows of 500 formulas: column A holds the input, B a
+// formula over it, then a chain "=<left>+1". With a clamping B ("=A*0+1")
+// an edit of the inputs changes no value past column B; with a passing B
+// ("=A+1") every value changes, which is the worst case for the cutoff.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int ROWS = 1000;
+constexpr int FORMULAS_PER_ROW = 500;
+constexpr std::int64_t FORMULA_COUNT = std::int64_t{ROWS} * FORMULAS_PER_ROW;
+
+void Run(bool early_cutoff, bool clamped) {
+    SheetOptions options;
+    options.early_cutoff = early_cutoff;
+    Sheet sheet(options);
+    for (int row = 0; row < ROWS; ++row) {
+        // from the end, so that the cycle checks see no formulas
+        for (int col = FORMULAS_PER_ROW; col > 1; --col) {
+            sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+1");
+        }
+        const std::string input(Position{row, 0}.ToString());
+        sheet.SetCell({row, 1}, clamped ? "=" + input + "*0+1" : "=" + input + "+1");
+        sheet.SetCell({row, 0}, "0");
+    }
+    sheet.Recalculate();
+
+    RecalcStats stats;
+    const std::string name = std::string(early_cutoff ? "cutoff" : "no cutoff")
+                             + (clamped ? ", clamped" : ", passing");
+    Measure(name + ": edit inputs", FORMULA_COUNT, [&] {
+        for (int row = 0; row < ROWS; ++row) {
+            sheet.SetCell({row, 0}, "1");
+        }
+    });
+    Measure(name + ": recalculate", FORMULA_COUNT, [&] {
+        stats = sheet.Recalculate();
+    });
+    std::cout << "    evaluated " << stats.evaluated << ", skipped " << stats.skipped << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    for (bool clamped : {true, false}) {
+        Run(false, clamped);
+        Run(true, clamped);
+    }
+}
@@ -0,0 +1,108 @@
+// Cycle checks of new formulas on acyclic sheets: 100 chains of 1000
+// "=<left>+1" built from the start and from the end, a grid of 7 x 1000
+// where a formula averages four cells of the row above, built from the
+// top. Then edits of a built sheet: formulas at the chain ends set again,
+// chain heads pointed at their own ends (rejected as cycles) and the heads
+// of the even chains at the end of the next chain, which makes the order of
+// both chains change.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int CHAINS = 100;
+constexpr int CHAIN_LENGTH = 1000;
+constexpr std::int64_t CHAIN_FORMULAS = std::int64_t{CHAINS} * CHAIN_LENGTH;
+
+std::string Next(int row, int col) {
+    return "=" + std::string(Position{row, col - 1}.ToString()) + "+1";
+}
+
+void BuildForward(Sheet& sheet) {
+    for (int row = 0; row < CHAINS; ++row) {
+        sheet.SetCell({row, 0}, "0");
+        for (int col = 1; col <= CHAIN_LENGTH; ++col) {
+            sheet.SetCell({row, col}, Next(row, col));
+        }
+    }
+}
+
+void Chains() {
+    {
+        Sheet sheet;
+        Measure("chains: build from the start", CHAIN_FORMULAS, [&] {
+            BuildForward(sheet);
+        });
+    }
+    {
+        Sheet sheet;
+        Measure("chains: build from the end", CHAIN_FORMULAS, [&] {
+            for (int row = 0; row < CHAINS; ++row) {
+                for (int col = CHAIN_LENGTH; col > 0; --col) {
+                    sheet.SetCell({row, col}, Next(row, col));
+                }
+                sheet.SetCell({row, 0}, "0");
+            }
+        });
+    }
+
+    Sheet sheet;
+    BuildForward(sheet);
+    constexpr int EDITS = 10;
+    Measure("chains: set the last formulas again", CHAINS * EDITS, [&] {
+        for (int edit = 0; edit < EDITS; ++edit) {
+            for (int row = 0; row < CHAINS; ++row) {
+                sheet.SetCell({row, CHAIN_LENGTH}, Next(row, CHAIN_LENGTH));
+            }
+        }
+    });
+    int rejected = 0;
+    Measure("chains: point the heads at their ends", CHAINS, [&] {
+        for (int row = 0; row < CHAINS; ++row) {
+            try {
+                sheet.SetCell({row, 1}, "=" + std::string(Position{row, CHAIN_LENGTH}.ToString()));
+            } catch (const CircularDependencyException&) {
+                ++rejected;
+            }
+        }
+    });
+    std::cout << "    rejected " << rejected << std::endl;
+    Measure("chains: point the heads at the next ends", CHAINS / 2, [&] {
+        for (int row = 0; row + 1 < CHAINS; row += 2) {
+            sheet.SetCell({row, 1}, "=" + std::string(Position{row + 1, CHAIN_LENGTH}.ToString()));
+        }
+    });
+    std::cout << "    value " << std::get<double>(sheet.GetCell({0, CHAIN_LENGTH})->GetValue())
+              << std::endl;
+}
+
+void Grid() {
+    constexpr int ROWS = 7;
+    constexpr int FORMULA_COLS = 1000;
+    Sheet sheet;
+    for (int col = 0; col < FORMULA_COLS + 3; ++col) {
+        sheet.SetCell({0, col}, "1");
+    }
+    Measure("grid: build from the top", std::int64_t{ROWS} * FORMULA_COLS, [&] {
+        for (int row = 1; row <= ROWS; ++row) {
+            for (int col = 0; col < FORMULA_COLS; ++col) {
+                std::string text = "=(";
+                for (int k = 0; k < 4; ++k) {
+                    text += (k > 0 ? "+" : "") + std::string(Position{row - 1, col + k}.ToString());
+                }
+                sheet.SetCell({row, col}, text + ")/4");
+            }
+        }
+    });
+}
+
+}  // namespace
+
+int main() {
+    Chains();
+    Grid();
+}
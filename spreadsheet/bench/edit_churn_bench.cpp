@@ -0,0 +1,84 @@
+// A long editing session: 20000 formulas over 1000 inputs, each averaging
+// 8 inputs. An edit replaces a random formula by one that keeps 7 of its
+// references and swaps the 8th for another input. After every 100K edits
+// reports the edit time, the graph size and the formulas a write of 10
+// inputs invalidates; the last two stay flat when replaced formulas leave
+// no edges behind.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int INPUTS = 1000;
+constexpr int ROWS = 20;
+constexpr int FORMULAS = ROWS * INPUTS;
+constexpr int REFS = 8;
+constexpr int ROUNDS = 5;
+constexpr int EDITS_PER_ROUND = 100'000;
+
+using Refs = std::array<int, REFS>;
+
+std::string Text(const Refs& refs) {
+    std::string text = "=(";
+    for (int k = 0; k < REFS; ++k) {
+        text += (k > 0 ? "+" : "") + std::string(Position{0, refs[k]}.ToString());
+    }
+    return text + ")/8";
+}
+
+}  // namespace
+
+int main() {
+    Sheet sheet;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> input(0, INPUTS - 1);
+    std::uniform_int_distribution<int> formula(0, FORMULAS - 1);
+    std::uniform_int_distribution<int> ref(0, REFS - 1);
+
+    for (int col = 0; col < INPUTS; ++col) {
+        sheet.SetCell({0, col}, "1");
+    }
+    std::vector<Refs> refs(FORMULAS);
+    for (int f = 0; f < FORMULAS; ++f) {
+        for (int& r : refs[f]) {
+            r = input(gen);
+        }
+        sheet.SetCell({1 + f / INPUTS, f % INPUTS}, Text(refs[f]));
+    }
+
+    for (int round = 1; round <= ROUNDS; ++round) {
+        // the texts are made up front, so that the edits are measured alone
+        std::vector<int> edited(EDITS_PER_ROUND);
+        std::vector<std::string> texts(EDITS_PER_ROUND);
+        for (int i = 0; i < EDITS_PER_ROUND; ++i) {
+            const int f = formula(gen);
+            refs[f][ref(gen)] = input(gen);
+            edited[i] = f;
+            texts[i] = Text(refs[f]);
+        }
+        Measure("round " + std::to_string(round) + ": replace formulas", EDITS_PER_ROUND, [&] {
+            for (int i = 0; i < EDITS_PER_ROUND; ++i) {
+                const int f = edited[i];
+                sheet.SetCell({1 + f / INPUTS, f % INPUTS}, texts[i]);
+            }
+        });
+
+        sheet.Recalculate();
+        RecalcStats stats;
+        Measure("round " + std::to_string(round) + ": write 10 inputs", 10, [&] {
+            for (int col = 0; col < 10; ++col) {
+                sheet.SetCell({0, col}, std::to_string(round));
+            }
+            stats = sheet.Recalculate();
+        });
+        std::cout << "    invalidated " << stats.evaluated << " formulas, dependencies "
+                  << sheet.GetMemoryStats().dependencies / 1024 << " KiB" << std::endl;
+    }
+}
@@ -0,0 +1,45 @@
+// Recalculation of sheets saturated with errors: 1000 chains of 100
+// formulas behind one input, and 100K formulas reading that input directly.
+// The input alternates between two texts, so that every formula evaluates
+// to #VALUE!, or between two numbers for the same sheets without errors.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int ROWS = 1000;
+constexpr int COLS = 100;
+constexpr std::int64_t FORMULAS = std::int64_t{ROWS} * COLS;
+
+void Run(const char* shape, bool chains, bool errors) {
+    Sheet sheet;
+    sheet.SetCell({0, 0}, "1");
+    for (int row = 1; row <= ROWS; ++row) {
+        for (int col = 0; col < COLS; ++col) {
+            const Position ref = chains && col > 0 ? Position{row, col - 1} : Position{0, 0};
+            sheet.SetCell({row, col}, "=" + std::string(ref.ToString()) + "*2+1");
+        }
+    }
+    sheet.Recalculate();
+
+    const std::string name = std::string(shape) + (errors ? ", errors" : ", numbers");
+    for (int round = 0; round < 3; ++round) {
+        sheet.SetCell({0, 0}, errors ? (round % 2 ? "a" : "b") : std::to_string(round));
+        Measure(name + ": recalculate", FORMULAS, [&] {
+            sheet.Recalculate();
+        });
+    }
+}
+
+}  // namespace
+
+int main() {
+    for (bool errors : {false, true}) {
+        Run("chains", true, errors);
+        Run("fan-out", false, errors);
+    }
+}
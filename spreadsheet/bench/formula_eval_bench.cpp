@@ -0,0 +1,66 @@
+// Evaluation throughput of parsed formulas, the cell caches bypassed: a
+// small formula, a wide one (a sum of 64 cells), a deep one (64 nested
+// operations, constants and cells alternating) and formulas with constant
+// subexpressions. Reports the time per operator or operand as written.
+
+#include "../common.h"
+#include "../formula.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int TERMS = 64;
+
+std::string CellName(int i) {
+    return std::string(Position{i / 8, i % 8}.ToString());
+}
+
+std::string Wide() {
+    std::string text;
+    for (int i = 0; i < TERMS; ++i) {
+        text += (i > 0 ? "+" : "") + CellName(i);
+    }
+    return text;
+}
+
+std::string Deep() {
+    // no divisions: a nested one ends up dividing by zero
+    static const char OPS[] = "+*-*";
+    std::string text;
+    for (int i = 0; i < TERMS; ++i) {
+        text += (i % 2 ? std::to_string(i % 7 + 1) : CellName(i)) + OPS[i % 4] + "(";
+    }
+    return text + "1" + std::string(TERMS, ')');
+}
+
+void Run(const std::string& name, const std::string& expression, int node_count,
+         const SheetInterface& sheet) {
+    constexpr int EVALUATIONS = 200'000;
+    const auto formula = ParseFormula(expression);
+    double sum = 0;
+    Measure(name, std::int64_t{EVALUATIONS} * node_count, [&] {
+        for (int i = 0; i < EVALUATIONS; ++i) {
+            const FormulaInterface::Value value = formula->Evaluate(sheet);
+            sum += std::holds_alternative<double>(value) ? std::get<double>(value) : 0;
+        }
+    });
+    std::cout << "    checksum " << sum << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    auto sheet = CreateSheet();
+    for (int i = 0; i < TERMS; ++i) {
+        sheet->SetCell({i / 8, i % 8}, std::to_string(i % 5 + 1));
+    }
+    Run("small: (A1+B1)*2/C1", "(A1+B1)*2/C1", 7, *sheet);
+    Run("wide: 64 cells summed", Wide(), 2 * TERMS - 1, *sheet);
+    Run("deep: 64 nested operations", Deep(), 2 * TERMS + 1, *sheet);
+    Run("constants: 2*3*A1+0", "2*3*A1+0", 7, *sheet);
+    Run("constants: (1+2)/(4-1)*B2", "(1+2)/(4-1)*B2", 9, *sheet);
+    Run("constants: 2*A1+B1*3-C1/4+1", "2*A1+B1*3-C1/4+1", 13, *sheet);
+}
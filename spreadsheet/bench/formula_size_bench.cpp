@@ -0,0 +1,81 @@
+// Memory and parse time of formulas: 20K copies of a small formula, a wide
+// one (a sum of 64 cells) and a deep one (64 nested operations) parsed into
+// a memory resource that counts its blocks. Reports the bytes and blocks a
+// formula keeps: the formula object, its tree and its compiled program.
+
+#include "../common.h"
+#include "../formula.h"
+#include "bench_utils.h"
+
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int FORMULAS = 20'000;
+constexpr int TERMS = 64;
+
+class BlockCounter : public std::pmr::memory_resource {
+public:
+    std::int64_t bytes = 0;
+    std::int64_t blocks = 0;
+
+private:
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        bytes += static_cast<std::int64_t>(size);
+        ++blocks;
+        return std::pmr::get_default_resource()->allocate(size, alignment);
+    }
+    void do_deallocate(void* ptr, std::size_t size, std::size_t alignment) override {
+        bytes -= static_cast<std::int64_t>(size);
+        --blocks;
+        std::pmr::get_default_resource()->deallocate(ptr, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+std::string CellName(int i) {
+    return std::string(Position{i / 8, i % 8}.ToString());
+}
+
+std::string Wide() {
+    std::string text;
+    for (int i = 0; i < TERMS; ++i) {
+        text += (i > 0 ? "+" : "") + CellName(i);
+    }
+    return text;
+}
+
+std::string Deep() {
+    static const char OPS[] = "+*-/";
+    std::string text;
+    for (int i = 0; i < TERMS; ++i) {
+        text += (i % 2 ? std::to_string(i % 7 + 1) : CellName(i)) + OPS[i % 4] + "(";
+    }
+    return text + "1" + std::string(TERMS, ')');
+}
+
+void Run(const std::string& name, const std::string& expression) {
+    BlockCounter resource;
+    std::vector<std::unique_ptr<FormulaInterface>> formulas;
+    formulas.reserve(FORMULAS);
+    Measure(name + ": parse", FORMULAS, [&] {
+        for (int i = 0; i < FORMULAS; ++i) {
+            formulas.push_back(ParseFormula(expression, &resource));
+        }
+    });
+    std::cout << "    " << double(resource.bytes) / FORMULAS << " bytes, "
+              << double(resource.blocks) / FORMULAS << " blocks per formula" << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    Run("small: (A1+B1)*2/C1", "(A1+B1)*2/C1");
+    Run("wide: 64 cells summed", Wide());
+    Run("deep: 64 nested operations", Deep());
+}
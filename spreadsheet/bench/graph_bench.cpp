@@ -0,0 +1,101 @@
+// Dependency graph memory and traversal speed. Two sheets of formulas:
+// 1000 chains of 1000 "=<left>+1" (one edge per formula) and a grid of
+// 500 x 1000 where a formula averages four cells of the row above (four
+// edges).
+// Reports the bytes of the graph, the edit that invalidates every formula
+// and the read that evaluates them all again through their references.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int COLS = 1000;
+
+void Report(const Sheet& sheet, std::int64_t edge_count) {
+    const SheetMemoryStats stats = sheet.GetMemoryStats();
+    std::cout << "    dependencies " << stats.dependencies / 1024 << " KiB, "
+              << static_cast<double>(stats.dependencies) / edge_count << " bytes per edge"
+              << std::endl;
+}
+
+void Chains() {
+    constexpr int ROWS = 1000;
+    constexpr std::int64_t FORMULAS = std::int64_t{ROWS} * COLS;
+    Sheet sheet;
+    Measure("chains: build", FORMULAS, [&] {
+        for (int row = 0; row < ROWS; ++row) {
+            // from the end, so that the cycle checks see no formulas
+            for (int col = COLS; col > 0; --col) {
+                sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+1");
+            }
+            sheet.SetCell({row, 0}, "0");
+        }
+    });
+    Report(sheet, FORMULAS);
+    const CellInterface* last = sheet.GetCell({ROWS - 1, COLS});
+    for (int round = 1; round <= 2; ++round) {
+        for (int row = 0; row < ROWS; ++row) {
+            sheet.GetCell({row, COLS})->GetValue();
+        }
+        Measure("chains: invalidate all", FORMULAS, [&] {
+            for (int row = 0; row < ROWS; ++row) {
+                sheet.SetCell({row, 0}, std::to_string(round));
+            }
+        });
+        Measure("chains: read all", FORMULAS, [&] {
+            for (int row = 0; row < ROWS; ++row) {
+                sheet.GetCell({row, COLS})->GetValue();
+            }
+        });
+    }
+    std::cout << "    value " << std::get<double>(last->GetValue()) << std::endl;
+}
+
+void Grid() {
+    constexpr int ROWS = 500;
+    constexpr int FORMULA_COLS = COLS - 3;
+    constexpr std::int64_t FORMULAS = std::int64_t{ROWS} * FORMULA_COLS;
+    Sheet sheet;
+    Measure("grid: build", FORMULAS, [&] {
+        // from the bottom, so that the cycle checks see no formulas
+        for (int row = ROWS; row > 0; --row) {
+            for (int col = 0; col < FORMULA_COLS; ++col) {
+                std::string text = "=(";
+                for (int k = 0; k < 4; ++k) {
+                    text += (k > 0 ? "+" : "") + std::string(Position{row - 1, col + k}.ToString());
+                }
+                sheet.SetCell({row, col}, text + ")/4");
+            }
+        }
+        for (int col = 0; col < COLS; ++col) {
+            sheet.SetCell({0, col}, "1");
+        }
+    });
+    Report(sheet, FORMULAS * 4);
+    const CellInterface* last = sheet.GetCell({ROWS, 0});
+    for (int round = 1; round <= 2; ++round) {
+        sheet.Recalculate();
+        Measure("grid: invalidate all", FORMULAS, [&] {
+            for (int col = 0; col < COLS; ++col) {
+                sheet.SetCell({0, col}, std::to_string(round));
+            }
+        });
+        Measure("grid: read all", FORMULAS, [&] {
+            for (int col = 0; col < FORMULA_COLS; ++col) {
+                sheet.GetCell({ROWS, col})->GetValue();
+            }
+        });
+    }
+    std::cout << "    value " << std::get<double>(last->GetValue()) << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    Chains();
+    Grid();
+}
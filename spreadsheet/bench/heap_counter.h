@@ -0,0 +1,61 @@
+#pragma once
+
+// Replaces the global operator new / delete to keep the number of live heap
+// bytes in live_bytes. Include it into exactly one file of a benchmark.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::int64_t live_bytes = 0;
+
+// every block starts with a header keeping its size
+constexpr std::size_t HEADER = alignof(std::max_align_t);
+
+void* Allocate(std::size_t size, std::size_t align) {
+    const std::size_t header = align > HEADER ? align : HEADER;
+    auto* block = static_cast<char*>(std::aligned_alloc(header, (size + 2 * header - 1) / header * header));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    live_bytes += static_cast<std::int64_t>(size);
+    *reinterpret_cast<std::size_t*>(block + header - sizeof(std::size_t)) = size;
+    return block + header;
+}
+
+void Free(void* ptr, std::size_t align) {
+    if (ptr == nullptr) {
+        return;
+    }
+    const std::size_t header = align > HEADER ? align : HEADER;
+    char* block = static_cast<char*>(ptr) - header;
+    live_bytes -= static_cast<std::int64_t>(*reinterpret_cast<std::size_t*>(block + header - sizeof(std::size_t)));
+    std::free(block);
+}
+}  // namespace
+
+void* operator new(std::size_t size) {
+    return Allocate(size, HEADER);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    return Allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* ptr) noexcept {
+    Free(ptr, HEADER);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    Free(ptr, HEADER);
+}
+
+void operator delete(void* ptr, std::align_val_t align) noexcept {
+    Free(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t align) noexcept {
+    Free(ptr, static_cast<std::size_t>(align));
+}
@@ -0,0 +1,51 @@
+// Cost of an edit in layered diamond graphs: every cell of a layer sums all
+// cells of the layer above, so the number of paths from the edited cell to
+// the last layer is WIDTH^(layers - 1).
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int WIDTH = 4;
+constexpr int EDITS = 20;
+
+void Run(int layers) {
+    Sheet sheet;
+    // bottom up, so that the cycle checks see no formulas
+    for (int row = layers - 1; row > 0; --row) {
+        std::string formula = "=";
+        for (int col = 0; col < WIDTH; ++col) {
+            formula += (col ? "+" : "") + Position{row - 1, col}.ToString();
+        }
+        for (int col = 0; col < WIDTH; ++col) {
+            sheet.SetCell({row, col}, formula);
+        }
+    }
+    for (int col = 0; col < WIDTH; ++col) {
+        sheet.SetCell({0, col}, "1");
+    }
+
+    Measure(std::to_string(layers) + " layers, edit", EDITS, [&] {
+        for (int edit = 0; edit < EDITS; ++edit) {
+            sheet.SetCell({0, 0}, std::to_string(edit));
+        }
+    });
+    Measure(std::to_string(layers) + " layers, edit and read", EDITS, [&] {
+        for (int edit = 0; edit < EDITS; ++edit) {
+            sheet.SetCell({0, 0}, std::to_string(edit));
+            sheet.GetCell({layers - 1, 0})->GetValue();
+        }
+    });
+}
+
+}  // namespace
+
+int main() {
+    for (int layers : {6, 8, 10, 12, 1000, 10000}) {
+        Run(layers);
+    }
+}
@@ -0,0 +1,79 @@
+// Full recalculation of a sheet with 1M formulas: 1000 rows, each a number
+// in column A followed by 1000 formulas "=<left>+1". Compares
+// Sheet::Recalculate with reading every formula after the same edit.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <string>
+
+namespace {
+
+constexpr int ROWS = 1000;
+constexpr int FORMULAS_PER_ROW = 1000;
+constexpr std::int64_t FORMULA_COUNT = std::int64_t{ROWS} * FORMULAS_PER_ROW;
+
+void EditInputs(Sheet& sheet, int value) {
+    for (int row = 0; row < ROWS; ++row) {
+        sheet.SetCell({row, 0}, std::to_string(value + row));
+    }
+}
+
+void Report(const RecalcStats& stats) {
+    std::cout << "    evaluated " << stats.evaluated
+              << (stats.plan_rebuilt ? ", plan rebuilt" : ", plan reused") << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    Sheet sheet;
+    // each row from its end, so that the cycle checks see no formulas
+    Measure("build, 1M formulas", FORMULA_COUNT, [&] {
+        for (int row = 0; row < ROWS; ++row) {
+            for (int col = FORMULAS_PER_ROW; col > 0; --col) {
+                sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+1");
+            }
+        }
+        EditInputs(sheet, 0);
+    });
+
+    RecalcStats stats;
+    Measure("recalculate, plan built", FORMULA_COUNT, [&] {
+        stats = sheet.Recalculate();
+    });
+    Report(stats);
+
+    EditInputs(sheet, 1);
+    Measure("recalculate, plan reused", FORMULA_COUNT, [&] {
+        stats = sheet.Recalculate();
+    });
+    Report(stats);
+
+    Measure("recalculate, nothing dirty", FORMULA_COUNT, [&] {
+        stats = sheet.Recalculate();
+    });
+    Report(stats);
+
+    EditInputs(sheet, 2);
+    Measure("pull: read every formula", FORMULA_COUNT, [&] {
+        for (int row = 0; row < ROWS; ++row) {
+            for (int col = 1; col <= FORMULAS_PER_ROW; ++col) {
+                sheet.GetCell({row, col})->GetValue();
+            }
+        }
+    });
+
+    // a referenced cell turns into a formula, the order goes stale
+    sheet.SetCell({0, 0}, "=1");
+    EditInputs(sheet, 3);
+    Measure("recalculate, plan rebuilt", FORMULA_COUNT, [&] {
+        stats = sheet.Recalculate();
+    });
+    Report(stats);
+
+    std::cout << "    last value "
+              << std::get<double>(sheet.GetCell({ROWS - 1, FORMULAS_PER_ROW})->GetValue())
+              << std::endl;
+}
@@ -0,0 +1,103 @@
+// Printable size maintenance when the extreme cells of a 10k-row sheet are
+// set and cleared: ordered row/column counts against the former backward
+// probing of the index tables.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// the size bookkeeping Sheet used before: nested index tables and a
+// backward probe after removing the bottom/right-most cell
+class LegacyBounds {
+public:
+    void Set(Position pos) {
+        rows_[pos.row].insert(pos.col);
+        cols_[pos.col].insert(pos.row);
+        size_.rows = std::max(size_.rows, pos.row + 1);
+        size_.cols = std::max(size_.cols, pos.col + 1);
+    }
+
+    void Clear(Position pos) {
+        Remove(rows_, pos.row, pos.col);
+        Remove(cols_, pos.col, pos.row);
+        if (size_ == Size{1, 1}) {
+            size_ = Size{0, 0};
+            return;
+        }
+        if (size_.rows - 1 == pos.row) {
+            size_.rows = ProbeBack(pos.row, rows_) + 1;
+        }
+        if (size_.cols - 1 == pos.col) {
+            size_.cols = ProbeBack(pos.col, cols_) + 1;
+        }
+    }
+
+    Size GetSize() const {
+        return size_;
+    }
+
+private:
+    using IndexTable = std::unordered_map<int, std::unordered_set<int>>;
+
+    static void Remove(IndexTable& table, int i, int j) {
+        auto it = table.find(i);
+        it->second.erase(j);
+        if (it->second.empty()) {
+            table.erase(it);
+        }
+    }
+    static int ProbeBack(int idx, const IndexTable& table) {
+        for (; table.find(idx) == table.end() && idx > 0; --idx) {}
+        return idx;
+    }
+
+    IndexTable rows_;
+    IndexTable cols_;
+    Size size_;
+};
+
+constexpr int ROWS = 10'000;
+constexpr int ROUNDS = 2'000;
+
+// a dense 100x100 corner plus a cell toggled at the far row / column
+template <typename SetFn, typename ClearFn, typename SizeFn>
+void Run(std::string_view name, SetFn set, ClearFn clear, SizeFn size) {
+    for (int row = 0; row < 100; ++row) {
+        for (int col = 0; col < 100; ++col) {
+            set(Position{row, col});
+        }
+    }
+    int checksum = 0;
+    Measure(name, 2 * ROUNDS, [&] {
+        for (int i = 0; i < ROUNDS; ++i) {
+            const Position far = i % 2 ? Position{ROWS - 1, i % 100} : Position{i % 100, ROWS - 1};
+            set(far);
+            checksum += size().rows;
+            clear(far);
+            checksum += size().cols;
+        }
+    });
+    std::cout << "  (checksum " << checksum << ')' << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    {
+        LegacyBounds legacy;
+        Run("backward probing, set + clear extreme", [&](Position pos) { legacy.Set(pos); },
+            [&](Position pos) { legacy.Clear(pos); }, [&] { return legacy.GetSize(); });
+    }
+    {
+        auto sheet = CreateSheet();
+        Run("ordered counts, set + clear extreme", [&](Position pos) { sheet->SetCell(pos, "x"); },
+            [&](Position pos) { sheet->ClearCell(pos); }, [&] { return sheet->GetPrintableSize(); });
+    }
+}
@@ -0,0 +1,160 @@
+// Cell lookup and full-sheet scan: the tiled CellStorage against the former
+// std::list<Cell> + nested unordered_map index; random-access GetCell latency
+// of the tiled and hashed storages on sparse sheets; range scans through the
+// ordered index against probing every position of the range.
+
+#include "../cell.h"
+#include "../cell_storage.h"
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <list>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// the layout Sheet::Impl used before the tiled storage
+class LegacyStorage {
+public:
+    Cell* Find(Position pos) {
+        auto row_it = rows_indices_.find(pos.row);
+        if (row_it == rows_indices_.end()) {
+            return nullptr;
+        }
+        auto cell_it = row_it->second.find(pos.col);
+        return cell_it == row_it->second.end() ? nullptr : &*cell_it->second;
+    }
+
+    Cell& Emplace(Position pos, CellContext& context) {
+        contents_.emplace_back(context);
+        auto it = std::prev(contents_.end());
+        rows_indices_[pos.row][pos.col] = it;
+        cols_indices_[pos.col][pos.row] = it;
+        return *it;
+    }
+
+private:
+    using IndexTable = std::unordered_map<int, std::unordered_map<int, std::list<Cell>::iterator>>;
+    std::list<Cell> contents_;
+    IndexTable rows_indices_;
+    IndexTable cols_indices_;
+};
+
+template <typename Storage>
+void Run(std::string_view name, Storage& storage, CellContext& context, Size size,
+         const std::vector<Position>& probes) {
+    const std::int64_t cell_count = std::int64_t{size.rows} * size.cols;
+    std::cout << name << ", " << size.rows << 'x' << size.cols << " cells" << std::endl;
+
+    Measure("  fill", cell_count, [&] {
+        for (int row = 0; row < size.rows; ++row) {
+            for (int col = 0; col < size.cols; ++col) {
+                storage.Emplace({row, col}, context);
+            }
+        }
+    });
+
+    size_t found = 0;
+    Measure("  random lookup", probes.size(), [&] {
+        for (Position pos : probes) {
+            found += storage.Find(pos) != nullptr;
+        }
+    });
+    Measure("  row-major scan", cell_count, [&] {
+        for (int row = 0; row < size.rows; ++row) {
+            for (int col = 0; col < size.cols; ++col) {
+                found += storage.Find({row, col}) != nullptr;
+            }
+        }
+    });
+    std::cout << "  (checksum " << found << ')' << std::endl;
+}
+
+// cell_count cells at random positions of the whole 16384x16384 sheet
+void RunSparse(CellStorageKind kind, std::string_view name, int cell_count) {
+    auto sheet = CreateSheet(SheetOptions{kind});
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> coord(0, Position::MAX_ROWS - 1);
+    std::vector<Position> filled;
+    for (int i = 0; i < cell_count; ++i) {
+        filled.push_back({coord(gen), coord(gen)});
+        sheet->SetCell(filled.back(), "x");
+    }
+    // half of the probes hit a cell, half miss
+    std::vector<Position> probes;
+    std::uniform_int_distribution<size_t> pick(0, filled.size() - 1);
+    for (int i = 0; i < 2'000'000; ++i) {
+        probes.push_back(i % 2 ? filled[pick(gen)] : Position{coord(gen), coord(gen)});
+    }
+
+    size_t found = 0;
+    const SheetInterface& const_sheet = *sheet;
+    Measure(std::string(name) + ", " + std::to_string(cell_count) + " cells, GetCell", probes.size(),
+            [&] {
+                for (Position pos : probes) {
+                    found += const_sheet.GetCell(pos) != nullptr;
+                }
+            });
+    std::cout << "  (checksum " << found << ')' << std::endl;
+
+    // a 2048x2048 window scanned cell by cell and through the ordered index
+    const Position top_left{4096, 4096};
+    const Position bottom_right{6143, 6143};
+    const std::int64_t area = std::int64_t{2048} * 2048;
+    size_t in_range = 0;
+    Measure("    range scan by probing", area, [&] {
+        for (int row = top_left.row; row <= bottom_right.row; ++row) {
+            for (int col = top_left.col; col <= bottom_right.col; ++col) {
+                in_range += const_sheet.GetCell({row, col}) != nullptr;
+            }
+        }
+    });
+    Measure("    range scan by ForEachInRange", area, [&] {
+        static_cast<const Sheet&>(const_sheet).ForEachInRange(top_left, bottom_right,
+                                                              [&](Position, const CellInterface&) {
+            ++in_range;
+        });
+    });
+    std::cout << "  (checksum " << in_range << ')' << std::endl;
+}
+
+}  // namespace
+
+int main() {
+    const Size size{1024, 1024};
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> row_dist(0, size.rows - 1);
+    std::uniform_int_distribution<int> col_dist(0, size.cols - 1);
+    std::vector<Position> probes(4'000'000);
+    for (Position& pos : probes) {
+        pos = {row_dist(gen), col_dist(gen)};
+    }
+
+    auto sheet = CreateSheet();
+    CellContext context(*sheet, std::pmr::get_default_resource());
+    {
+        LegacyStorage legacy;
+        Run("list + unordered_map index", legacy, context, size, probes);
+    }
+    {
+        TiledCellStorage tiled;
+        Run("tiled storage", tiled, context, size, probes);
+
+        size_t visited = 0;
+        Measure("  ordered index scan", std::int64_t{size.rows} * size.cols, [&] {
+            tiled.ForEach([&visited](Position, const Cell&) {
+                ++visited;
+            });
+        });
+        std::cout << "  (checksum " << visited << ')' << std::endl;
+    }
+
+    std::cout << "sparse sheets" << std::endl;
+    for (int cell_count : {1'000, 100'000}) {
+        RunSparse(CellStorageKind::Tiled, "  tiled", cell_count);
+        RunSparse(CellStorageKind::Hashed, "  hashed", cell_count);
+    }
+}
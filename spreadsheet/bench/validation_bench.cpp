@@ -0,0 +1,64 @@
+// Push invalidation against version stamps on 1000 inputs, each feeding a
+// chain of 100 formulas. A write sets a random input, a read gets the end
+// of a random chain. Traces: write-heavy, read-heavy and alternating.
+
+#include "../common.h"
+#include "../sheet.h"
+#include "bench_utils.h"
+
+#include <random>
+#include <string>
+
+namespace {
+
+constexpr int CHAINS = 1000;
+constexpr int CHAIN_LENGTH = 100;
+
+void Build(Sheet& sheet) {
+    for (int row = 0; row < CHAINS; ++row) {
+        // from the end, so that the cycle checks see no formulas
+        for (int col = CHAIN_LENGTH; col > 0; --col) {
+            sheet.SetCell({row, col}, "=" + Position{row, col - 1}.ToString() + "+1");
+        }
+        sheet.SetCell({row, 0}, "0");
+    }
+}
+
+void RunTrace(const char* mode, CacheValidation validation, const char* trace, int writes_per_step,
+              int reads_per_step, int steps) {
+    SheetOptions options;
+    options.validation = validation;
+    Sheet sheet(options);
+    Build(sheet);
+    sheet.Recalculate();
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> chain(0, CHAINS - 1);
+    double sum = 0;
+    const std::int64_t op_count = std::int64_t{steps} * (writes_per_step + reads_per_step);
+    Measure(std::string(mode) + ", " + trace, op_count, [&] {
+        for (int step = 0; step < steps; ++step) {
+            for (int i = 0; i < writes_per_step; ++i) {
+                sheet.SetCell({chain(gen), 0}, std::to_string(step % 10));
+            }
+            for (int i = 0; i < reads_per_step; ++i) {
+                sum += std::get<double>(sheet.GetCell({chain(gen), CHAIN_LENGTH})->GetValue());
+            }
+        }
+    });
+    std::cout << "    checksum " << sum << std::endl;
+}
+
+void Run(const char* trace, int writes_per_step, int reads_per_step, int steps) {
+    RunTrace("push", CacheValidation::PushInvalidation, trace, writes_per_step, reads_per_step, steps);
+    RunTrace("versions", CacheValidation::VersionStamps, trace, writes_per_step, reads_per_step,
+             steps);
+}
+
+}  // namespace
+
+int main() {
+    Run("write-heavy (100 writes : 1 read)", 100, 1, 2'000);
+    Run("read-heavy (1 write : 100 reads)", 1, 100, 2'000);
+    Run("mixed (1 write : 1 read)", 1, 1, 100'000);
+}
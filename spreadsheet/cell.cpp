@@ -1,178 +1,480 @@
 #include "cell.h"
 
+#include "cell_storage.h"
+
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <optional>
 
+static_assert(sizeof(Cell) <= 64, "Cell is expected to fit in a cache line");
 
-class Cell::Impl {
-public:
-    virtual ~Impl() = default;
-    virtual CellInterface::Value GetValue(const SheetInterface&) const = 0;
-    virtual std::string GetText() const = 0;
-    virtual std::vector<Position> GetReferencedCells() const = 0;
-};
-
-class Cell::EmptyImpl final : public Impl {
-public:
-    EmptyImpl() = default;
-    CellInterface::Value GetValue(const SheetInterface&) const override {
-        return double(0);
+std::uint32_t CellContext::NextEpoch() {
+    if (++epoch == 0) {
+        // stamps of old traversals could match the new epoch numbers
+        storage->ForEach([](Position, const Cell& cell) {
+            const_cast<Cell&>(cell).epoch_ = 0;
+        });
+        epoch = 1;
     }
-    std::string GetText() const override {
-        return "";
-    }
-    std::vector<Position> GetReferencedCells() const override {
-        return {};
+    return epoch;
+}
+
+std::uint32_t CellContext::NextVersion() {
+    if (++version == 0) {
+        // old stamps could match the new versions
+        storage->ForEach([](Position, const Cell& cell) {
+            cell.changed_at_ = 0;
+            cell.has_cache_ = false;
+        });
+        version = 1;
     }
-};
+    return version;
+}
+
+size_t Cell::GetValueCacheSize() {
+    return sizeof(FormulaData::number) + sizeof(FormulaData::error)
+           + sizeof(FormulaData::verified_at);
+}
+
+// Реализуйте следующие методы
+Cell::Cell(CellContext& context)
+    : context_(context) {
+}
 
-class Cell::TextImpl final : public Impl {
-public:
-    TextImpl(std::string text) 
-        : text_(std::move(text)) {
+Cell::~Cell() {
+    ResetContent();
+    if (node_ != DependencyGraph::NO_NODE) {
+        context_.graph.RemoveNode(node_);
     }
-    CellInterface::Value GetValue(const SheetInterface&) const override {
-        if (text_.empty()) {
-            return "";
-        }
-        if (text_[0] == ESCAPE_SIGN) {
-            return text_.substr(1, text_.size() - 1);
-        }
-        return text_;
+}
+
+namespace {
+// text that formulas treat as a number
+bool IsNumber(std::string_view text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](unsigned char c) {
+        return std::isdigit(c);
+    });
+}
+
+std::variant<double, FormulaError> ParseNumber(std::string_view text) {
+    double value = 0;
+    if (std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc{}) {
+        // too many digits for a double
+        return FormulaError{FormulaError::Category::Value};
     }
-    std::string GetText() const override {
-        return text_;
+    return value;
+}
+}  // namespace
+
+Cell* GetCell(SheetInterface& sheet, Position pos) {
+    auto cell_it = sheet.GetCell(pos);
+    return cell_it == nullptr ? nullptr : dynamic_cast<Cell*>(cell_it);
+}
+
+DependencyGraph::NodeId Cell::GetNode() {
+    if (node_ == DependencyGraph::NO_NODE) {
+        node_ = context_.graph.AddNode(this);
     }
-    std::vector<Position> GetReferencedCells() const override {
-        return {};
+    return node_;
+}
+
+void Cell::ResetContent() {
+    switch (kind_) {
+        case Kind::PooledText:
+            context_.text_pool.Release(content_.pooled_text);
+            break;
+        case Kind::Formula:
+            context_.plan.OnFormulaRemoved(this);
+            delete content_.formula.formula;
+            break;
+        default:
+            break;
     }
-private:
-    std::string text_;
-};
+    kind_ = Kind::Empty;
+    has_cache_ = false;
+}
 
-class Cell::FormulaImpl final : public Impl {
-public:
-    FormulaImpl(std::string text) 
-        : formula_(ParseFormula(text)) {
+void Cell::MakeFormula(std::string text) {
+    std::unique_ptr<FormulaInterface> formula = ParseFormula(text.substr(1), &context_.formula_resource);
+    std::vector<Position> tmp_ref_cells = formula->GetReferencedCells();
+    CheckCircularDependency(tmp_ref_cells);
+
+    const bool was_formula = kind_ == Kind::Formula;
+    std::vector<Position> old_ref_cells;
+    if (was_formula) {
+        old_ref_cells = content_.formula.formula->GetReferencedCells();
     }
-    CellInterface::Value GetValue(const SheetInterface& sheet) const override {
+    ResetContent();
+    content_.formula = FormulaData{formula.release(), 0.0, 0, 0};
+    kind_ = Kind::Formula;
+    UpdateReferences(old_ref_cells, tmp_ref_cells);
+    // evaluation reads the referenced cells through these, rebound when a
+    // cell is created or destroyed there
+    for (const Position pos : tmp_ref_cells) {
+        content_.formula.formula->BindCell(pos, GetCell(context_.sheet, pos));
+    }
+    context_.plan.OnFormulaSet(this, was_formula);
+}
 
-        FormulaInterface::Value formula_val = formula_->Evaluate(sheet);
-        if (std::holds_alternative<double>(formula_val)) {
-            return std::get<double>(formula_val);
+void Cell::UpdateReferences(const std::vector<Position>& old_refs,
+                            const std::vector<Position>& new_refs) {
+    // both lists are sorted, the positions in both keep their edges
+    auto old_it = old_refs.begin();
+    auto new_it = new_refs.begin();
+    while (old_it != old_refs.end() || new_it != new_refs.end()) {
+        if (new_it == new_refs.end() || (old_it != old_refs.end() && *old_it < *new_it)) {
+            RemoveReference(*old_it++);
+        } else if (old_it == old_refs.end() || *new_it < *old_it) {
+            AddReference(*new_it++);
+        } else {
+            ++old_it;
+            ++new_it;
         }
-        return std::get<FormulaError>(formula_val);
     }
+}
 
-    std::string GetText() const override {
-        using namespace std::literals;
-        return "="s + formula_->GetExpression();
+void Cell::AddReference(Position pos) {
+    if (Cell* cell = GetCell(context_.sheet, pos)) {
+        context_.graph.AddEdge(GetNode(), cell->GetNode());
+    } else {
+        // no cell there yet, wait for it in the side table
+        auto [it, inserted] = context_.pending_dependents.try_emplace(PackPosition(pos));
+        it->second.insert(this);
     }
+}
 
-    std::vector<Position> GetReferencedCells() const override {
-        return formula_->GetReferencedCells();
+void Cell::RemoveReference(Position pos) {
+    // a cell created at a pending position adopts the pending formulas, so
+    // the edge is in the graph exactly when the position has a cell
+    if (Cell* cell = GetCell(context_.sheet, pos)) {
+        context_.graph.RemoveEdge(node_, cell->node_);
+        return;
+    }
+    auto it = context_.pending_dependents.find(PackPosition(pos));
+    if (it != context_.pending_dependents.end() && it->second.erase(this) > 0
+        && it->second.empty()) {
+        context_.pending_dependents.erase(it);
     }
-
-
-private:
-    std::unique_ptr<FormulaInterface> formula_;
-};
-
-// Реализуйте следующие методы
-Cell::Cell(SheetInterface& sheet)
-    : impl_(std::make_unique<EmptyImpl>())
-    , sheet_(sheet) {
 }
 
-Cell::~Cell() = default;
-
-Cell* GetCell(SheetInterface& sheet, Position pos) {
-    auto cell_it = sheet.GetCell(pos);
-    return cell_it == nullptr ? nullptr : dynamic_cast<Cell*>(cell_it);
+void Cell::DetachReferences() {
+    if (kind_ != Kind::Formula) {
+        return;
+    }
+    if (node_ != DependencyGraph::NO_NODE) {
+        context_.graph.ClearReferences(node_);
+    }
+    for (const Position pos : content_.formula.formula->GetReferencedCells()) {
+        auto it = context_.pending_dependents.find(PackPosition(pos));
+        if (it != context_.pending_dependents.end() && it->second.erase(this) > 0
+            && it->second.empty()) {
+            context_.pending_dependents.erase(it);
+        }
+    }
 }
 
-Cell* GetOrCreate(SheetInterface& sheet, Position pos) {
-    if (!sheet.GetCell(pos)) {
-        sheet.SetCell(pos, "");
+void Cell::AdoptDependents(Position pos) {
+    auto it = context_.pending_dependents.find(PackPosition(pos));
+    if (it == context_.pending_dependents.end()) {
+        return;
     }
-    return GetCell(sheet, pos);
+    for (Cell* cell : it->second) {
+        context_.graph.AddEdge(cell->GetNode(), GetNode());
+        cell->content_.formula.formula->BindCell(pos, this);
+    }
+    context_.pending_dependents.erase(it);
 }
 
-void Cell::SwapImpl(std::unique_ptr<Impl>&& src) {
-    impl_ = std::move(src);
-    for (const Position pos : impl_->GetReferencedCells()) {
-        Cell* cell = GetOrCreate(sheet_, pos);
-        referenced_cells_.insert(cell);
-        cell->dependent_cells_.insert(this);
+void Cell::Detach(Position pos) {
+    if (context_.validation == CacheValidation::PushInvalidation) {
+        InvalidateCache();
+    } else {
+        context_.NextVersion();
+    }
+    DetachReferences();
+    if (!HasDependents()) {
+        return;
     }
+    auto [it, inserted] = context_.pending_dependents.try_emplace(PackPosition(pos));
+    context_.graph.ClearDependents(node_, [&set = it->second, pos](Cell* cell) {
+        // version stamps cannot tell that an operand is gone
+        cell->has_cache_ = false;
+        cell->content_.formula.formula->BindCell(pos, nullptr);
+        set.insert(cell);
+    });
 }
 
-void Cell::MakeFormula(std::string text) {
-    std::unique_ptr<Impl> tmp_impl = std::make_unique<FormulaImpl>(text.substr(1));
-    std::vector<Position> tmp_ref_cells = std::move(tmp_impl->GetReferencedCells());
-    if (!tmp_ref_cells.empty()) {
-        CheckCircularDependency(tmp_ref_cells);
+void Cell::SetText(const std::string& text) {
+    // acquired first: the old content may hold the same text
+    const TextPool::Text* pooled = text.size() > INLINE_TEXT_CAPACITY
+                                   ? context_.text_pool.Acquire(text) : nullptr;
+    DetachReferences();
+    ResetContent();
+    if (text.size() <= NUMBER_TEXT_CAPACITY && IsNumber(text)) {
+        // so few digits always fit in a double
+        content_.number.value = std::get<double>(ParseNumber(text));
+        content_.number.size = static_cast<std::uint8_t>(text.size());
+        std::memcpy(content_.number.data, text.data(), text.size());
+        kind_ = Kind::Number;
+    } else if (text.size() <= INLINE_TEXT_CAPACITY) {
+        content_.inline_text.size = static_cast<std::uint8_t>(text.size());
+        std::memcpy(content_.inline_text.data, text.data(), text.size());
+        kind_ = Kind::InlineText;
+    } else {
+        content_.pooled_text = pooled;
+        kind_ = Kind::PooledText;
     }
-    SwapImpl(std::move(tmp_impl));
 }
 
 void Cell::Set(std::string text) {
-    InvalidateCache();
+    if (context_.validation == CacheValidation::PushInvalidation) {
+        InvalidateCache();
+    } else {
+        changed_at_ = context_.NextVersion();
+    }
     if (text.empty()) {
         Clear();
     } else if (text.at(0) == FORMULA_SIGN && text.size() > 1) {
-        MakeFormula(text);
+        MakeFormula(std::move(text));
     } else {
-        impl_ = std::make_unique<TextImpl>(text);
+        SetText(text);
     }
 }
 
-void Cell::CheckCircularDependency(std::vector<Position>& ref_cells) {
-    std::unordered_set<Cell *> visited_cells;
-    CheckCircularDependencyRef(ref_cells, visited_cells);
+void Cell::CheckCircularDependency(const std::vector<Position>& ref_cells) {
+    for (const Position pos : ref_cells) {
+        // positions without a cell have no references, so close no cycle
+        Cell* cell = GetCell(context_.sheet, pos);
+        if (cell && !context_.graph.OrderEdge(GetNode(), cell->GetNode())) {
+            throw CircularDependencyException{"circular dependency"};
+        }
+    }
 }
 
-void Cell::CheckCircularDependencyRef(std::vector<Position>& ref_cells
-                                , std::unordered_set<Cell*>& visited) {
-    for (const Position pos : ref_cells) {
+void Cell::Clear() {
+    DetachReferences();
+    ResetContent();
+}
 
-        Cell* cell_ptr = GetCell(sheet_, pos);
-        if (cell_ptr == this) {
-            throw CircularDependencyException{"circular dependency"};
+std::string_view Cell::GetTextView() const {
+    switch (kind_) {
+        case Kind::InlineText:
+            return {content_.inline_text.data, content_.inline_text.size};
+        case Kind::PooledText:
+            return content_.pooled_text->View();
+        case Kind::Number:
+            return {content_.number.data, content_.number.size};
+        default:
+            return {};
+    }
+}
+
+Cell::Value Cell::GetValue() const {
+    ValueView view = GetValueView();
+    if (std::holds_alternative<std::string_view>(view)) {
+        return std::string(std::get<std::string_view>(view));
+    }
+    if (std::holds_alternative<double>(view)) {
+        return std::get<double>(view);
+    }
+    return std::get<FormulaError>(view);
+}
+
+Cell::ValueView Cell::GetValueView() const {
+    switch (kind_) {
+        case Kind::Empty:
+            return double(0);
+        case Kind::Number:
+            return GetTextView();
+        case Kind::InlineText:
+        case Kind::PooledText: {
+            std::string_view text = GetTextView();
+            if (text[0] == ESCAPE_SIGN) {
+                text.remove_prefix(1);
+            }
+            return text;
         }
-        if (cell_ptr && visited.count(cell_ptr) == 0) {
-            auto new_ref_cells = cell_ptr->GetReferencedCells();
-            if (!new_ref_cells.empty()) {
-                CheckCircularDependencyRef(new_ref_cells, visited);
+        case Kind::Formula:
+            break;
+    }
+    const FormulaInterface::Value value = GetFormulaValue();
+    if (std::holds_alternative<double>(value)) {
+        return std::get<double>(value);
+    }
+    return std::get<FormulaError>(value);
+}
+
+std::variant<double, FormulaError> Cell::GetNumericValue() const {
+    switch (kind_) {
+        case Kind::Empty:
+            return double(0);
+        case Kind::Number:
+            return content_.number.value;
+        case Kind::InlineText:
+        case Kind::PooledText: {
+            // the operand is the value of the cell, without the escape sign
+            const std::string_view text = std::get<std::string_view>(GetValueView());
+            if (text.empty()) {
+                return double(0);
+            }
+            if (!IsNumber(text)) {
+                return FormulaError{FormulaError::Category::Value};
             }
-            visited.insert(this);
+            return ParseNumber(text);
         }
+        case Kind::Formula:
+            break;
     }
+    return GetFormulaValue();
 }
 
-void Cell::Clear() {
-    impl_ = std::make_unique<EmptyImpl>();
+FormulaInterface::Value Cell::GetFormulaValue() const {
+    assert(kind_ == Kind::Formula);
+    if (!HasValidCache()) {
+        EvaluateDirtyCone();
+    }
+    return GetCachedValue();
 }
 
-Cell::Value Cell::GetValue() const {
-    if (!cache_.has_value()) {
-        cache_ = impl_->GetValue(sheet_);
+FormulaInterface::Value Cell::GetCachedValue() const {
+    if (content_.formula.error == 0) {
+        return content_.formula.number;
+    }
+    return FormulaError(static_cast<FormulaError::Category>(content_.formula.error - 1));
+}
+
+void Cell::EvaluateDirtyCone() const {
+    // Post-order DFS over the referenced formulas without a cached value: a
+    // cell is evaluated after everything it refers to, so Evaluate() finds
+    // its operands cached and the native stack depth does not depend on the
+    // length of the dependency chain.
+    const std::uint32_t epoch = context_.NextEpoch();
+    auto& stack = context_.eval_stack;
+    stack.clear();
+    stack.emplace_back(this, false);
+    while (!stack.empty()) {
+        const auto [cell, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            cell->Refresh();
+            continue;
+        }
+        if (cell->epoch_ == epoch) {
+            continue;  // reached by another path and already expanded
+        }
+        cell->epoch_ = epoch;
+        stack.emplace_back(cell, true);
+        cell->ForEachReferencedCell([&stack, epoch](const Cell* ref) {
+            if (ref->kind_ == Kind::Formula && !ref->HasValidCache() && ref->epoch_ != epoch) {
+                stack.emplace_back(ref, false);
+            }
+        });
+    }
+}
+
+bool Cell::Evaluate() const {
+    const FormulaInterface::Value value = content_.formula.formula->Evaluate(context_.sheet);
+    double number = 0;
+    std::uint8_t error = 0;
+    if (std::holds_alternative<double>(value)) {
+        number = std::get<double>(value);
+    } else {
+        error = static_cast<std::uint8_t>(std::get<FormulaError>(value).GetCategory()) + 1;
     }
-    return cache_.value();
+    // bit-exact: 0 and -0 compare equal but print differently
+    const bool changed = std::memcmp(&number, &content_.formula.number, sizeof(number)) != 0
+                         || error != content_.formula.error;
+    content_.formula.number = number;
+    content_.formula.error = error;
+    has_cache_ = true;
+    must_evaluate_ = false;
+    return changed;
+}
+
+void Cell::MarkDependentsForEvaluation() const {
+    ForEachDependentCell([](const Cell* dependent) {
+        dependent->must_evaluate_ = true;
+    });
 }
+
+Cell::RefreshResult Cell::Refresh(bool mark_dependents) const {
+    if (context_.validation == CacheValidation::VersionStamps) {
+        // evaluate if the formula is new or an input changed after the
+        // last check; the inputs are checked already
+        bool stale = !has_cache_;
+        if (!stale) {
+            ForEachReferencedCell([this, &stale](const Cell* ref) {
+                stale |= ref->changed_at_ > content_.formula.verified_at;
+            });
+        }
+        content_.formula.verified_at = context_.version;
+        if (!stale) {
+            return RefreshResult::Skipped;
+        }
+        if (!Evaluate()) {
+            return RefreshResult::Unchanged;
+        }
+        changed_at_ = context_.version;
+        return RefreshResult::Changed;
+    }
+
+    if (CanSkipEvaluation()) {
+        has_cache_ = true;
+        return RefreshResult::Skipped;
+    }
+    if (!Evaluate()) {
+        return RefreshResult::Unchanged;
+    }
+    if (mark_dependents && context_.early_cutoff) {
+        MarkDependentsForEvaluation();
+    }
+    return RefreshResult::Changed;
+}
+
 std::string Cell::GetText() const {
-    return impl_->GetText();
+    if (kind_ == Kind::Formula) {
+        using namespace std::literals;
+        return "="s + content_.formula.formula->GetExpression();
+    }
+    return std::string(GetTextView());
 }
 
 void Cell::InvalidateCache() {
-    cache_.reset();
-    for (const auto cell : dependent_cells_) {
-        cell->InvalidateCache();
+    // depth-first over the dependents, each cell is visited once even when
+    // it is reachable by several paths. A formula without a cached value is
+    // not entered: evaluation caches the operands of a formula before the
+    // formula itself, so none of its dependents has a cached value either.
+    if (context_.early_cutoff) {
+        // the content changes, so do the operand values of the dependents
+        must_evaluate_ = true;
+        MarkDependentsForEvaluation();
+    }
+    const std::uint32_t epoch = context_.NextEpoch();
+    std::vector<Cell*>& stack = context_.work_stack;
+    stack.clear();
+    epoch_ = epoch;
+    stack.push_back(this);
+    while (!stack.empty()) {
+        Cell* cell = stack.back();
+        stack.pop_back();
+        cell->has_cache_ = false;
+        cell->ForEachDependentCell([&stack, epoch](Cell* dependent) {
+            if (dependent->epoch_ != epoch && dependent->has_cache_) {
+                dependent->epoch_ = epoch;
+                stack.push_back(dependent);
+            }
+        });
     }
 }
 
 std::vector<Position> Cell::GetReferencedCells() const {
-    return impl_->GetReferencedCells();
+    if (kind_ == Kind::Formula) {
+        return content_.formula.formula->GetReferencedCells();
+    }
+    return {};
 }
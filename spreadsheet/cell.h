@@ -1,44 +1,236 @@
 #pragma once
 
 #include "common.h"
+#include "cell_index.h"
+#include "dependency_graph.h"
 #include "formula.h"
+#include "pmr_utils.h"
+#include "recalc_plan.h"
+#include "text_pool.h"
+#include <cstdint>
 #include <memory>
-#include <optional>
+#include <memory_resource>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
+class Cell;
+class CellStorage;
+
+// How a sheet finds out that a cached formula value is stale.
+enum class CacheValidation {
+    // a write clears the caches of its dependent closure, reads of valid
+    // caches cost nothing
+    PushInvalidation,
+    // a write only stamps the cell with a new sheet version, a read checks
+    // the stamps of the inputs of the formula and of their inputs
+    VersionStamps,
+};
+
+// State shared by the cells of one sheet.
+struct CellContext {
+    CellContext(SheetInterface& sheet, std::pmr::memory_resource* resource)
+        : sheet(sheet)
+        , text_resource(resource)
+        , formula_resource(resource)
+        , edge_resource(resource)
+        , text_pool(&text_resource)
+        , graph(&edge_resource)
+        , pending_dependents(&edge_resource) {
+    }
+
+    // starts a new graph traversal, cells stamped with the returned epoch
+    // are visited by it
+    std::uint32_t NextEpoch();
+    // a new sheet version for a write; when the counter wraps around all
+    // caches are dropped
+    std::uint32_t NextVersion();
+
+    SheetInterface& sheet;
+    // a counter per component over the sheet's memory resource
+    CountingResource text_resource;
+    CountingResource formula_resource;  // one block per formula
+    CountingResource edge_resource;     // dependency graph and the side table
+    // longer texts of all cells, identical ones are stored once
+    TextPool text_pool;
+    DependencyGraph graph;
+    // formula cells referring to positions without a cell, by packed
+    // position; an entry lives while some formula refers to it
+    std::pmr::unordered_map<std::uint32_t, std::pmr::unordered_set<Cell*>> pending_dependents;
+    // evaluation order of the formulas for Sheet::Recalculate
+    RecalcPlan plan;
+    // a dirty formula is evaluated only if its own text or the value of
+    // one of its operands changed, see Cell::must_evaluate_
+    bool early_cutoff = false;
+    CacheValidation validation = CacheValidation::PushInvalidation;
+    // version stamps: the current sheet version, see Cell::changed_at_
+    std::uint32_t version = 0;
+
+    // the cells, to reset the epoch stamps when the counter wraps around
+    const CellStorage* storage = nullptr;
+    std::uint32_t epoch = 0;
+    // reused by graph traversals so that they do not allocate
+    std::vector<Cell*> work_stack;
+    std::vector<std::pair<const Cell*, bool>> eval_stack;  // cell, its references are pushed
+};
+
+// A cell is a tagged union of its content, 64 bytes with the vtable pointer.
+// Short text lives inside the cell, longer text is shared through the text
+// pool and the edges are kept in the dependency graph of the sheet.
 class Cell : public CellInterface {
+    friend struct CellContext;
+    friend class RecalcPlan;
+
 public:
-    Cell(SheetInterface& sheet);
+    explicit Cell(CellContext& context);
+    Cell(const Cell&) = delete;
+    Cell& operator=(const Cell&) = delete;
     ~Cell();
 
     void Set(std::string text);
     void Clear();
 
+    // links the formulas waiting for a cell at pos to this newly created cell
+    void AdoptDependents(Position pos);
+    // unlinks the cell at pos from the graph before it is erased, the
+    // formulas referring to it wait for a new cell in the side table
+    void Detach(Position pos);
+
     Value GetValue() const override;
+    ValueView GetValueView() const override;
+    std::variant<double, FormulaError> GetNumericValue() const override;
     std::string GetText() const override;
     std::vector<Position> GetReferencedCells() const override;
 
+    bool IsEmpty() const {
+        return kind_ == Kind::Empty;
+    }
+    bool IsFormula() const {
+        return kind_ == Kind::Formula;
+    }
+
+    // bytes of a formula cell taken by its cached value and version stamp
+    static size_t GetValueCacheSize();
+
+    static constexpr size_t INLINE_TEXT_CAPACITY = 22;
+    // longer numerals are kept as text and parsed on every read
+    static constexpr size_t NUMBER_TEXT_CAPACITY = 15;
+
 private:
-    class Impl;
-    class EmptyImpl;
-    class TextImpl;
-    class FormulaImpl;
+    enum class Kind : std::uint8_t {
+        Empty,
+        InlineText,  // text of at most INLINE_TEXT_CAPACITY chars
+        PooledText,  // longer text, shared with the equal texts of other cells
+        Number,      // numeral parsed on Set, the text is kept for GetText
+        Formula,
+    };
+
+    struct InlineText {
+        char data[INLINE_TEXT_CAPACITY];
+        std::uint8_t size;
+    };
+    struct NumberData {
+        double value;
+        char data[NUMBER_TEXT_CAPACITY];
+        std::uint8_t size;
+    };
+    // the cached value is packed, so that the version stamp fits next to it
+    struct FormulaData {
+        FormulaInterface* formula;  // owned
+        mutable double number;
+        mutable std::uint8_t error;  // 0 for a number, else 1 + FormulaError::Category
+        // version stamps: the sheet version the cache was last checked at
+        mutable std::uint32_t verified_at;
+    };
+    union Content {
+        Content() : inline_text() {}
+        InlineText inline_text;
+        const TextPool::Text* pooled_text;
+        NumberData number;
+        FormulaData formula;
+    };
 
 private:
     void InvalidateCache();
 
-    /* cycle dependency checkers */
-    void CheckCircularDependency(std::vector<Position>& ref_cells);
-    void CheckCircularDependencyRef(std::vector<Position>& ref_cells
-                                , std::unordered_set<Cell*>& visited);
+    // throws CircularDependencyException if a formula of this cell referring
+    // to the cells would close a cycle
+    void CheckCircularDependency(const std::vector<Position>& ref_cells);
 
     void MakeFormula(std::string text);
-    void SwapImpl(std::unique_ptr<Impl>&& src);
+    // drops the edges of the current formula
+    void DetachReferences();
+    // applies the difference of two sorted reference lists to the edges
+    void UpdateReferences(const std::vector<Position>& old_refs,
+                          const std::vector<Position>& new_refs);
+    void AddReference(Position pos);
+    void RemoveReference(Position pos);
+    void SetText(const std::string& text);
+    // frees the current content, the cell becomes empty
+    void ResetContent();
+    std::string_view GetTextView() const;
+    // evaluates the formula unless the cached value is valid
+    FormulaInterface::Value GetFormulaValue() const;
+    FormulaInterface::Value GetCachedValue() const;
+    bool HasValidCache() const {
+        return has_cache_
+               && (context_.validation == CacheValidation::PushInvalidation
+                   || content_.formula.verified_at == context_.version);
+    }
+    // evaluates the formula and every formula it depends on without a valid
+    // cache, with an explicit stack instead of recursion
+    void EvaluateDirtyCone() const;
+    // evaluates the formula into the cache, the operands are not evaluated;
+    // true if the value differs bit-exactly from the cached one, which is
+    // what moves changed_at_ under version stamps
+    bool Evaluate() const;
+    // early cutoff: a dirty formula whose operands kept their values is
+    // valid again without evaluation
+    bool CanSkipEvaluation() const {
+        return context_.early_cutoff && !must_evaluate_;
+    }
+    // early cutoff: the direct dependents have to be evaluated
+    void MarkDependentsForEvaluation() const;
+    enum class RefreshResult : std::uint8_t {
+        Skipped,    // the cached value is valid again without evaluation
+        Unchanged,  // evaluated to the cached value
+        Changed,
+    };
+    // brings a formula without a valid cache up to date, its operands must
+    // be valid; the early cutoff marks the dependents if mark_dependents
+    RefreshResult Refresh(bool mark_dependents = true) const;
+    // node in the dependency graph, added on the first edge
+    DependencyGraph::NodeId GetNode();
+    template <typename Fn>
+    void ForEachReferencedCell(Fn&& fn) const {
+        if (node_ != DependencyGraph::NO_NODE) {
+            context_.graph.ForEachReference(node_, std::forward<Fn>(fn));
+        }
+    }
+    template <typename Fn>
+    void ForEachDependentCell(Fn&& fn) const {
+        if (node_ != DependencyGraph::NO_NODE) {
+            context_.graph.ForEachDependent(node_, std::forward<Fn>(fn));
+        }
+    }
+    bool HasDependents() const {
+        return node_ != DependencyGraph::NO_NODE && context_.graph.HasDependents(node_);
+    }
 
 private:
-    std::unique_ptr<Impl> impl_;
-    std::unordered_set<Cell*> dependent_cells_; /* cache invalidation */
-    std::unordered_set<Cell*> referenced_cells_; /* cycle deps checking */
-    SheetInterface& sheet_;
-    mutable std::optional<Value> cache_;
-};
\ No newline at end of file
+    CellContext& context_;
+    Content content_;
+    DependencyGraph::NodeId node_ = DependencyGraph::NO_NODE;
+    Kind kind_ = Kind::Empty;
+    mutable bool has_cache_ = false;  // the cached formula value is valid
+    // early cutoff: the formula or an operand value changed since the last
+    // evaluation, the cache is stale even if the operands turn out unchanged
+    mutable bool must_evaluate_ = false;
+    // the last traversal that visited the cell, see CellContext::NextEpoch
+    mutable std::uint32_t epoch_ = 0;
+    // index in the RecalcPlan order while the cell holds a formula
+    std::uint32_t plan_slot_ = 0;
+    // version stamps: the sheet version the value last changed at
+    mutable std::uint32_t changed_at_ = 0;
+};
@@ -0,0 +1,236 @@
+#include "cell_index.h"
+
+#include <array>
+#include <cassert>
+
+OrderedCellIndex::OrderedCellIndex() {
+    root_ = NewLeaf();
+}
+
+OrderedCellIndex::~OrderedCellIndex() {
+    Destroy(root_);
+}
+
+OrderedCellIndex::Leaf* OrderedCellIndex::NewLeaf() {
+    auto* leaf = new Leaf;
+    node_bytes_ += sizeof(Leaf);
+    return leaf;
+}
+
+OrderedCellIndex::Inner* OrderedCellIndex::NewInner() {
+    auto* inner = new Inner;
+    node_bytes_ += sizeof(Inner);
+    return inner;
+}
+
+void OrderedCellIndex::DeleteNode(Node* node) {
+    if (node->is_leaf) {
+        node_bytes_ -= sizeof(Leaf);
+        delete static_cast<Leaf*>(node);
+    } else {
+        node_bytes_ -= sizeof(Inner);
+        delete static_cast<Inner*>(node);
+    }
+}
+
+void OrderedCellIndex::Destroy(Node* node) {
+    if (node->is_leaf) {
+        delete static_cast<Leaf*>(node);
+        return;
+    }
+    auto* inner = static_cast<Inner*>(node);
+    for (int i = 0; i < inner->count; ++i) {
+        Destroy(inner->children[i]);
+    }
+    delete inner;
+}
+
+namespace {
+// index of the child of an inner node the key belongs to
+template <typename Inner>
+int ChildIndex(const Inner* inner, std::uint32_t key) {
+    return static_cast<int>(std::upper_bound(inner->keys, inner->keys + inner->count - 1, key)
+                            - inner->keys);
+}
+}  // namespace
+
+// inner nodes and child indexes from the root down to a leaf; the tree grows
+// a level only when the root fills up, so MAX_HEIGHT levels are never reached
+class OrderedCellIndex::Path {
+public:
+    void Push(Inner* inner, int child) {
+        assert(size_ < MAX_HEIGHT && "OrderedCellIndex err: tree is too high");
+        steps_[size_++] = {inner, child};
+    }
+    std::pair<Inner*, int> Pop() {
+        return steps_[--size_];
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+private:
+    static constexpr int MAX_HEIGHT = 16;
+    std::array<std::pair<Inner*, int>, MAX_HEIGHT> steps_;
+    int size_ = 0;
+};
+
+OrderedCellIndex::Cursor OrderedCellIndex::LowerBound(std::uint32_t key) const {
+    const Node* node = root_;
+    while (!node->is_leaf) {
+        const auto* inner = static_cast<const Inner*>(node);
+        node = inner->children[ChildIndex(inner, key)];
+    }
+    const auto* leaf = static_cast<const Leaf*>(node);
+    Cursor cursor{leaf, static_cast<int>(std::lower_bound(leaf->keys, leaf->keys + leaf->count, key)
+                                         - leaf->keys)};
+    if (cursor.idx == leaf->count) {
+        cursor = Cursor{leaf->next, 0};
+    }
+    return cursor;
+}
+
+void OrderedCellIndex::Insert(Position pos, Cell* cell) {
+    const std::uint32_t key = PackPosition(pos);
+
+    // descend remembering the path, split full nodes on the way back
+    Path path;
+    Node* node = root_;
+    while (!node->is_leaf) {
+        auto* inner = static_cast<Inner*>(node);
+        const int child = ChildIndex(inner, key);
+        path.Push(inner, child);
+        node = inner->children[child];
+    }
+
+    auto* leaf = static_cast<Leaf*>(node);
+    const int idx = static_cast<int>(std::lower_bound(leaf->keys, leaf->keys + leaf->count, key)
+                                     - leaf->keys);
+    assert((idx == leaf->count || leaf->keys[idx] != key) && "OrderedCellIndex::Insert err: duplicate key");
+    std::copy_backward(leaf->keys + idx, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::copy_backward(leaf->cells + idx, leaf->cells + leaf->count, leaf->cells + leaf->count + 1);
+    leaf->keys[idx] = key;
+    leaf->cells[idx] = cell;
+    ++leaf->count;
+    ++size_;
+
+    if (leaf->count < LEAF_CAPACITY) {
+        return;
+    }
+
+    // split the leaf in halves
+    auto* right = NewLeaf();
+    const int half = leaf->count / 2;
+    right->count = leaf->count - half;
+    std::copy(leaf->keys + half, leaf->keys + leaf->count, right->keys);
+    std::copy(leaf->cells + half, leaf->cells + leaf->count, right->cells);
+    leaf->count = half;
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next != nullptr) {
+        leaf->next->prev = right;
+    }
+    leaf->next = right;
+
+    Node* new_node = right;
+    std::uint32_t separator = right->keys[0];
+    while (new_node != nullptr) {
+        if (path.Empty()) {
+            auto* new_root = NewInner();
+            new_root->children[0] = root_;
+            new_root->children[1] = new_node;
+            new_root->keys[0] = separator;
+            new_root->count = 2;
+            root_ = new_root;
+            return;
+        }
+
+        auto [parent, child] = path.Pop();
+        // insert (separator, new_node) right after the child
+        std::copy_backward(parent->keys + child, parent->keys + parent->count - 1,
+                           parent->keys + parent->count);
+        std::copy_backward(parent->children + child + 1, parent->children + parent->count,
+                           parent->children + parent->count + 1);
+        parent->keys[child] = separator;
+        parent->children[child + 1] = new_node;
+        ++parent->count;
+
+        new_node = nullptr;
+        if (parent->count == INNER_CAPACITY) {
+            auto* right_inner = NewInner();
+            const int keep = parent->count / 2;
+            right_inner->count = parent->count - keep;
+            std::copy(parent->children + keep, parent->children + parent->count,
+                      right_inner->children);
+            std::copy(parent->keys + keep, parent->keys + parent->count - 1, right_inner->keys);
+            separator = parent->keys[keep - 1];
+            parent->count = keep;
+            new_node = right_inner;
+        }
+    }
+}
+
+bool OrderedCellIndex::Erase(Position pos) {
+    const std::uint32_t key = PackPosition(pos);
+
+    Path path;
+    Node* node = root_;
+    while (!node->is_leaf) {
+        auto* inner = static_cast<Inner*>(node);
+        const int child = ChildIndex(inner, key);
+        path.Push(inner, child);
+        node = inner->children[child];
+    }
+
+    auto* leaf = static_cast<Leaf*>(node);
+    const int idx = static_cast<int>(std::lower_bound(leaf->keys, leaf->keys + leaf->count, key)
+                                     - leaf->keys);
+    if (idx == leaf->count || leaf->keys[idx] != key) {
+        return false;
+    }
+    std::copy(leaf->keys + idx + 1, leaf->keys + leaf->count, leaf->keys + idx);
+    std::copy(leaf->cells + idx + 1, leaf->cells + leaf->count, leaf->cells + idx);
+    --leaf->count;
+    --size_;
+
+    if (leaf->count > 0 || path.Empty()) {
+        return true;
+    }
+
+    // unlink the empty leaf and then every inner node left without children
+    if (leaf->prev != nullptr) {
+        leaf->prev->next = leaf->next;
+    }
+    if (leaf->next != nullptr) {
+        leaf->next->prev = leaf->prev;
+    }
+    DeleteNode(leaf);
+
+    while (!path.Empty()) {
+        auto [parent, child] = path.Pop();
+        // drop children[child] together with the separator in front of it
+        const int key_idx = child > 0 ? child - 1 : 0;
+        std::copy(parent->keys + key_idx + 1, parent->keys + parent->count - 1,
+                  parent->keys + key_idx);
+        std::copy(parent->children + child + 1, parent->children + parent->count,
+                  parent->children + child);
+        if (--parent->count > 0) {
+            break;
+        }
+        if (path.Empty()) {
+            // the root lost its last child, the tree is empty
+            DeleteNode(parent);
+            root_ = NewLeaf();
+            return true;
+        }
+        DeleteNode(parent);
+    }
+
+    // collapse the root while it has a single child
+    while (!root_->is_leaf && root_->count == 1) {
+        auto* old_root = static_cast<Inner*>(root_);
+        root_ = old_root->children[0];
+        DeleteNode(old_root);
+    }
+    return true;
+}
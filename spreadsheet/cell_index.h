@@ -0,0 +1,148 @@
+#pragma once
+
+#include "common.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+class Cell;
+
+// Position packed as (row << POSITION_COL_BITS) | col, fits in 28 bits.
+// Packed positions compare in row-major order.
+inline constexpr int POSITION_COL_BITS = 14;
+static_assert(Position::MAX_COLS == 1 << POSITION_COL_BITS);
+static_assert(Position::MAX_ROWS <= 1 << POSITION_COL_BITS);
+
+inline std::uint32_t PackPosition(Position pos) {
+    return (static_cast<std::uint32_t>(pos.row) << POSITION_COL_BITS)
+           | static_cast<std::uint32_t>(pos.col);
+}
+
+inline Position UnpackPosition(std::uint32_t key) {
+    return {static_cast<int>(key >> POSITION_COL_BITS),
+            static_cast<int>(key & ((1u << POSITION_COL_BITS) - 1))};
+}
+
+// B+-tree from packed positions to cells. Leaves are linked, so row-major
+// iteration is a walk over contiguous arrays and a range scan costs
+// O((cells in range + rows with cells) * log n).
+// Erase never merges nodes: a node is unlinked only when it becomes empty.
+class OrderedCellIndex {
+public:
+    OrderedCellIndex();
+    OrderedCellIndex(const OrderedCellIndex&) = delete;
+    OrderedCellIndex& operator=(const OrderedCellIndex&) = delete;
+    ~OrderedCellIndex();
+
+    // the key must not be in the index
+    void Insert(Position pos, Cell* cell);
+    // returns false if there was no such key
+    bool Erase(Position pos);
+
+    size_t GetSize() const {
+        return size_;
+    }
+    // bytes taken by the tree nodes
+    size_t GetMemoryBytes() const {
+        return node_bytes_;
+    }
+
+    // calls fn(pos, cell) for every cell inside the rectangle, row-major order
+    template <typename Fn>
+    void ForEachInRange(Position top_left, Position bottom_right, Fn&& fn) const;
+    // calls fn(pos, cell) for every cell, row-major order
+    template <typename Fn>
+    void ForEach(Fn&& fn) const;
+
+private:
+    static constexpr int LEAF_CAPACITY = 64;
+    static constexpr int INNER_CAPACITY = 64;
+
+    struct Node {
+        bool is_leaf;
+        int count = 0;  // keys in a leaf, children in an inner node
+    };
+    struct Leaf;
+    struct Inner;
+    class Path;
+
+    // position inside a leaf, leaf == nullptr past the end
+    struct Cursor {
+        const Leaf* leaf;
+        int idx;
+    };
+
+    Cursor LowerBound(std::uint32_t key) const;
+    static void Next(Cursor& cursor);
+    static std::uint32_t KeyAt(const Cursor& cursor);
+    static Cell* CellAt(const Cursor& cursor);
+
+    Leaf* NewLeaf();
+    Inner* NewInner();
+    // frees a single node
+    void DeleteNode(Node* node);
+    // frees the whole subtree
+    static void Destroy(Node* node);
+
+    Node* root_ = nullptr;
+    size_t size_ = 0;
+    size_t node_bytes_ = 0;
+};
+
+struct OrderedCellIndex::Leaf : Node {
+    Leaf() : Node{true} {}
+    std::uint32_t keys[LEAF_CAPACITY];
+    Cell* cells[LEAF_CAPACITY];
+    Leaf* prev = nullptr;
+    Leaf* next = nullptr;
+};
+
+struct OrderedCellIndex::Inner : Node {
+    Inner() : Node{false} {}
+    // keys[i] is the smallest key under children[i + 1]
+    std::uint32_t keys[INNER_CAPACITY - 1];
+    Node* children[INNER_CAPACITY];
+};
+
+inline void OrderedCellIndex::Next(Cursor& cursor) {
+    if (++cursor.idx == cursor.leaf->count) {
+        cursor.leaf = cursor.leaf->next;
+        cursor.idx = 0;
+    }
+}
+
+inline std::uint32_t OrderedCellIndex::KeyAt(const Cursor& cursor) {
+    return cursor.leaf->keys[cursor.idx];
+}
+
+inline Cell* OrderedCellIndex::CellAt(const Cursor& cursor) {
+    return cursor.leaf->cells[cursor.idx];
+}
+
+template <typename Fn>
+void OrderedCellIndex::ForEachInRange(Position top_left, Position bottom_right, Fn&& fn) const {
+    if (top_left.row > bottom_right.row || top_left.col > bottom_right.col) {
+        return;
+    }
+    const std::uint32_t last = PackPosition(bottom_right);
+    Cursor cursor = LowerBound(PackPosition(top_left));
+    while (cursor.leaf != nullptr && KeyAt(cursor) <= last) {
+        const Position pos = UnpackPosition(KeyAt(cursor));
+        if (pos.col < top_left.col) {
+            cursor = LowerBound(PackPosition({pos.row, top_left.col}));
+        } else if (pos.col > bottom_right.col) {
+            cursor = LowerBound(PackPosition({pos.row + 1, top_left.col}));
+        } else {
+            fn(pos, *CellAt(cursor));
+            Next(cursor);
+        }
+    }
+}
+
+template <typename Fn>
+void OrderedCellIndex::ForEach(Fn&& fn) const {
+    for (Cursor cursor = LowerBound(0); cursor.leaf != nullptr; Next(cursor)) {
+        fn(UnpackPosition(KeyAt(cursor)), *CellAt(cursor));
+    }
+}
@@ -0,0 +1,224 @@
+#include "cell_storage.h"
+
+#include <cassert>
+
+namespace {
+void Decrement(std::pmr::map<int, int>& counts, int key) {
+    auto it = counts.find(key);
+    assert(it != counts.end() && "CellStorage err: no count to decrement");
+    if (--it->second == 0) {
+        counts.erase(it);
+    }
+}
+}  // namespace
+
+Size CellStorage::GetBoundingSize() const {
+    if (cell_count_ == 0) {
+        return {0, 0};
+    }
+    return {row_counts_.rbegin()->first + 1, col_counts_.rbegin()->first + 1};
+}
+
+void CellStorage::OnEmplace(Position pos, Cell* cell) {
+    index_.Insert(pos, cell);
+    ++row_counts_[pos.row];
+    ++col_counts_[pos.col];
+    ++cell_count_;
+}
+
+void CellStorage::OnErase(Position pos) {
+    index_.Erase(pos);
+    Decrement(row_counts_, pos.row);
+    Decrement(col_counts_, pos.col);
+    --cell_count_;
+}
+
+std::unique_ptr<CellStorage> CreateCellStorage(CellStorageKind kind,
+                                               std::pmr::memory_resource* resource) {
+    switch (kind) {
+        case CellStorageKind::Tiled:
+            return std::make_unique<TiledCellStorage>(resource);
+        case CellStorageKind::Hashed:
+            return std::make_unique<HashedCellStorage>(resource);
+    }
+    assert(false && "CreateCellStorage err: unknown storage kind");
+    return nullptr;
+}
+
+/* TiledCellStorage */
+
+TiledCellStorage::Tile::~Tile() {
+    for (int r = 0; r < TILE_SIZE && count > 0; ++r) {
+        for (std::uint64_t word = occupied[r]; word != 0; word &= word - 1) {
+            At(r, CountTrailingZeros(word))->~Cell();
+            --count;
+        }
+    }
+}
+
+const Cell* TiledCellStorage::Find(Position pos) const {
+    const Band* band = bands_[pos.row >> TILE_BITS].get();
+    if (band == nullptr) {
+        return nullptr;
+    }
+    const Tile* tile = (*band)[pos.col >> TILE_BITS].get();
+    const int r = pos.row & TILE_MASK;
+    const int c = pos.col & TILE_MASK;
+    if (tile == nullptr || !tile->Has(r, c)) {
+        return nullptr;
+    }
+    return tile->At(r, c);
+}
+
+Cell& TiledCellStorage::Emplace(Position pos, CellContext& context) {
+    auto& band = bands_[pos.row >> TILE_BITS];
+    if (!band) {
+        band = NewObject<Band>(GetResource());
+        ++band_count_;
+    }
+    auto& tile = (*band)[pos.col >> TILE_BITS];
+    if (!tile) {
+        // default-initialized: the cell storage is not zeroed
+        tile = NewObject<Tile>(GetResource());
+        ++tile_count_;
+    }
+
+    const int r = pos.row & TILE_MASK;
+    const int c = pos.col & TILE_MASK;
+    assert(!tile->Has(r, c) && "TiledCellStorage::Emplace err: position is taken");
+    Cell* cell = new (tile->At(r, c)) Cell(context);
+    tile->occupied[r] |= std::uint64_t{1} << c;
+    ++tile->count;
+
+    OnEmplace(pos, cell);
+    return *cell;
+}
+
+bool TiledCellStorage::Erase(Position pos) {
+    Band* band = bands_[pos.row >> TILE_BITS].get();
+    if (band == nullptr) {
+        return false;
+    }
+    auto& tile = (*band)[pos.col >> TILE_BITS];
+    const int r = pos.row & TILE_MASK;
+    const int c = pos.col & TILE_MASK;
+    if (!tile || !tile->Has(r, c)) {
+        return false;
+    }
+
+    tile->At(r, c)->~Cell();
+    tile->occupied[r] &= ~(std::uint64_t{1} << c);
+    if (--tile->count == 0) {
+        tile.reset();
+        --tile_count_;
+    }
+
+    OnErase(pos);
+    return true;
+}
+
+size_t TiledCellStorage::GetStorageBytes() const {
+    return band_count_ * sizeof(Band) + tile_count_ * sizeof(Tile);
+}
+
+/* HashedCellStorage */
+
+HashedCellStorage::HashedCellStorage(std::pmr::memory_resource* resource)
+    : CellStorage(resource)
+    , table_(16, resource)
+    , shift_(32 - 4)
+    , chunks_(resource) {
+}
+
+HashedCellStorage::~HashedCellStorage() {
+    for (const Entry& entry : table_) {
+        if (entry.key != EMPTY_KEY) {
+            SlotAt(entry.slot).cell.~Cell();
+        }
+    }
+}
+
+size_t HashedCellStorage::Probe(std::uint32_t key) const {
+    const size_t mask = table_.size() - 1;
+    size_t idx = Bucket(key);
+    while (table_[idx].key != key && table_[idx].key != EMPTY_KEY) {
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+const Cell* HashedCellStorage::Find(Position pos) const {
+    const Entry& entry = table_[Probe(PackPosition(pos))];
+    return entry.key == EMPTY_KEY ? nullptr : &SlotAt(entry.slot).cell;
+}
+
+void HashedCellStorage::Grow() {
+    std::pmr::vector<Entry> old = std::move(table_);
+    table_.assign(old.size() * 2, Entry{});
+    --shift_;
+    for (const Entry& entry : old) {
+        if (entry.key != EMPTY_KEY) {
+            table_[Probe(entry.key)] = entry;
+        }
+    }
+}
+
+std::uint32_t HashedCellStorage::AllocateSlot() {
+    if (free_head_ != EMPTY_KEY) {
+        const std::uint32_t slot = free_head_;
+        free_head_ = SlotAt(slot).next_free;
+        return slot;
+    }
+    if ((slot_count_ & (CHUNK_SIZE - 1)) == 0) {
+        chunks_.push_back(NewObject<Chunk>(GetResource()));
+    }
+    return slot_count_++;
+}
+
+Cell& HashedCellStorage::Emplace(Position pos, CellContext& context) {
+    // keep the load factor under 1/2
+    if ((GetCellCount() + 1) * 2 > table_.size()) {
+        Grow();
+    }
+    const std::uint32_t key = PackPosition(pos);
+    Entry& entry = table_[Probe(key)];
+    assert(entry.key == EMPTY_KEY && "HashedCellStorage::Emplace err: position is taken");
+
+    const std::uint32_t slot = AllocateSlot();
+    Cell* cell = new (&SlotAt(slot).cell) Cell(context);
+    entry = Entry{key, slot};
+
+    OnEmplace(pos, cell);
+    return *cell;
+}
+
+bool HashedCellStorage::Erase(Position pos) {
+    size_t hole = Probe(PackPosition(pos));
+    if (table_[hole].key == EMPTY_KEY) {
+        return false;
+    }
+
+    Slot& slot = SlotAt(table_[hole].slot);
+    slot.cell.~Cell();
+    slot.next_free = free_head_;
+    free_head_ = table_[hole].slot;
+
+    // backward shift: move up the entries whose probe sequence passes the hole
+    const size_t mask = table_.size() - 1;
+    for (size_t idx = (hole + 1) & mask; table_[idx].key != EMPTY_KEY; idx = (idx + 1) & mask) {
+        const size_t home = Bucket(table_[idx].key);
+        if (((idx - home) & mask) >= ((idx - hole) & mask)) {
+            table_[hole] = table_[idx];
+            hole = idx;
+        }
+    }
+    table_[hole] = Entry{};
+
+    OnErase(pos);
+    return true;
+}
+
+size_t HashedCellStorage::GetStorageBytes() const {
+    return table_.capacity() * sizeof(Entry) + chunks_.capacity() * sizeof(PoolPtr<Chunk>)
+           + chunks_.size() * sizeof(Chunk);
+}
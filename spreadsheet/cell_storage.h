@@ -0,0 +1,211 @@
+#pragma once
+
+#include "cell.h"
+#include "cell_index.h"
+#include "common.h"
+#include "pmr_utils.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+inline int CountTrailingZeros(std::uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return static_cast<int>(idx);
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+enum class CellStorageKind {
+    Tiled,   // dense sheets: tiles allocated on demand
+    Hashed,  // very sparse sheets: flat hash table keyed by packed position
+};
+
+// Owns the cells of a sheet. A cell keeps its address until it is erased.
+// Every backend also maintains the ordered index for row-major scans.
+// Cells and the storage blocks are allocated from the memory resource.
+class CellStorage {
+public:
+    explicit CellStorage(std::pmr::memory_resource* resource)
+        : resource_(resource)
+        , counts_resource_(resource)
+        , row_counts_(&counts_resource_)
+        , col_counts_(&counts_resource_) {
+    }
+    virtual ~CellStorage() = default;
+
+    // nullptr if there is no cell with the position
+    virtual const Cell* Find(Position pos) const = 0;
+    Cell* Find(Position pos) {
+        return const_cast<Cell*>(static_cast<const CellStorage*>(this)->Find(pos));
+    }
+
+    // constructs an empty cell, the position must be free
+    virtual Cell& Emplace(Position pos, CellContext& context) = 0;
+    // returns false if there was no cell with the position
+    virtual bool Erase(Position pos) = 0;
+
+    // calls fn(pos, cell) for every cell inside the rectangle, row-major order
+    template <typename Fn>
+    void ForEachInRange(Position top_left, Position bottom_right, Fn&& fn) const {
+        index_.ForEachInRange(top_left, bottom_right, std::forward<Fn>(fn));
+    }
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        index_.ForEach(std::forward<Fn>(fn));
+    }
+
+    size_t GetCellCount() const {
+        return cell_count_;
+    }
+    // bounding box of all cells counted from A1, O(1)
+    Size GetBoundingSize() const;
+
+    // bytes of the blocks holding the cells, the cells included
+    virtual size_t GetStorageBytes() const = 0;
+    // bytes of the ordered index and the row / column counters
+    size_t GetIndexBytes() const {
+        return index_.GetMemoryBytes() + counts_resource_.GetBytesInUse();
+    }
+
+protected:
+    void OnEmplace(Position pos, Cell* cell);
+    void OnErase(Position pos);
+
+    std::pmr::memory_resource* GetResource() const {
+        return resource_;
+    }
+
+private:
+    std::pmr::memory_resource* resource_;
+    CountingResource counts_resource_;
+    OrderedCellIndex index_;
+    // cells per occupied row / column, the last keys give the bounding box
+    std::pmr::map<int, int> row_counts_;
+    std::pmr::map<int, int> col_counts_;
+    size_t cell_count_ = 0;
+};
+
+std::unique_ptr<CellStorage> CreateCellStorage(CellStorageKind kind,
+                                               std::pmr::memory_resource* resource);
+
+// The sheet is split into TILE_SIZE x TILE_SIZE tiles, a tile is allocated
+// on the first write into it. Cells are constructed in place inside the tile.
+// Lookup is two array indexes plus a bit test in the tile occupancy bitmap.
+class TiledCellStorage final : public CellStorage {
+public:
+    static constexpr int TILE_BITS = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_BITS;
+    static constexpr int TILE_MASK = TILE_SIZE - 1;
+    static constexpr int TILES_PER_SIDE = Position::MAX_ROWS / TILE_SIZE;
+
+    static_assert(Position::MAX_ROWS == Position::MAX_COLS);
+    static_assert(Position::MAX_ROWS % TILE_SIZE == 0);
+
+    explicit TiledCellStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : CellStorage(resource) {
+    }
+
+    using CellStorage::Find;
+    const Cell* Find(Position pos) const override;
+    Cell& Emplace(Position pos, CellContext& context) override;
+    bool Erase(Position pos) override;
+
+    size_t GetStorageBytes() const override;
+
+private:
+    struct Tile {
+        // bit c of occupied[r] is set if there is a cell at (r, c)
+        std::array<std::uint64_t, TILE_SIZE> occupied{};
+        int count = 0;
+        alignas(Cell) std::byte storage[TILE_SIZE * TILE_SIZE * sizeof(Cell)];
+
+        Tile() = default;
+        Tile(const Tile&) = delete;
+        Tile& operator=(const Tile&) = delete;
+        ~Tile();
+
+        bool Has(int r, int c) const {
+            return (occupied[r] >> c) & 1u;
+        }
+        Cell* At(int r, int c) {
+            return std::launder(reinterpret_cast<Cell*>(storage) + r * TILE_SIZE + c);
+        }
+        const Cell* At(int r, int c) const {
+            return std::launder(reinterpret_cast<const Cell*>(storage) + r * TILE_SIZE + c);
+        }
+    };
+    // a horizontal stripe of tiles
+    using Band = std::array<PoolPtr<Tile>, TILES_PER_SIDE>;
+
+    std::array<PoolPtr<Band>, TILES_PER_SIDE> bands_;
+    size_t band_count_ = 0;
+    size_t tile_count_ = 0;
+};
+
+// Open-addressing hash table (linear probing, backward shift deletion) from
+// packed positions to slots of a chunked cell pool. No allocation per cell:
+// the table and the pool grow by doubling / whole chunks.
+class HashedCellStorage final : public CellStorage {
+public:
+    explicit HashedCellStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    HashedCellStorage(const HashedCellStorage&) = delete;
+    HashedCellStorage& operator=(const HashedCellStorage&) = delete;
+    ~HashedCellStorage();
+
+    using CellStorage::Find;
+    const Cell* Find(Position pos) const override;
+    Cell& Emplace(Position pos, CellContext& context) override;
+    bool Erase(Position pos) override;
+
+    size_t GetStorageBytes() const override;
+
+private:
+    static constexpr std::uint32_t EMPTY_KEY = ~std::uint32_t{0};
+    static constexpr int CHUNK_BITS = 10;
+    static constexpr std::uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+
+    struct Entry {
+        std::uint32_t key = EMPTY_KEY;
+        std::uint32_t slot = 0;
+    };
+    union Slot {
+        Slot() : next_free(0) {}
+        ~Slot() {}
+        Cell cell;
+        std::uint32_t next_free;
+    };
+    using Chunk = std::array<Slot, CHUNK_SIZE>;
+
+    size_t Bucket(std::uint32_t key) const {
+        // Fibonacci hashing, the high bits are the best mixed ones
+        return static_cast<size_t>((key * 2654435769u) >> shift_);
+    }
+    // index of the entry with the key or of the empty entry ending its probe
+    size_t Probe(std::uint32_t key) const;
+    void Grow();
+
+    Slot& SlotAt(std::uint32_t slot) const {
+        return (*chunks_[slot >> CHUNK_BITS])[slot & (CHUNK_SIZE - 1)];
+    }
+    std::uint32_t AllocateSlot();
+
+    std::pmr::vector<Entry> table_;
+    int shift_ = 0;
+    std::pmr::vector<PoolPtr<Chunk>> chunks_;
+    std::uint32_t slot_count_ = 0;
+    std::uint32_t free_head_ = EMPTY_KEY;
+};
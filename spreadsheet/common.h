@@ -80,6 +80,9 @@ public:
     // Либо текст ячейки, либо значение формулы, либо сообщение об ошибке из
     // формулы
     using Value = std::variant<std::string, double, FormulaError>;
+    // То же значение, но текст не копируется: string_view указывает внутрь
+    // ячейки и действителен до следующего изменения этой ячейки.
+    using ValueView = std::variant<std::string_view, double, FormulaError>;
 
     virtual ~CellInterface() = default;
 
@@ -87,6 +90,12 @@ public:
     // В случае текстовой ячейки это её текст (без экранирующих символов). В
     // случае формулы - числовое значение формулы или сообщение об ошибке.
     virtual Value GetValue() const = 0;
+    // Возвращает видимое значение ячейки, не выделяя память.
+    virtual ValueView GetValueView() const = 0;
+    // Возвращает значение ячейки как операнда формулы: пустая ячейка - ноль,
+    // текст из одних цифр - число, прочий текст - ошибка #VALUE!, формула -
+    // её значение или ошибка.
+    virtual std::variant<double, FormulaError> GetNumericValue() const = 0;
     // Возвращает внутренний текст ячейки, как если бы мы начали её
     // редактирование. В случае текстовой ячейки это её текст (возможно,
     // содержащий экранирующие символы). В случае формулы - её выражение.
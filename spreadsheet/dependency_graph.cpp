@@ -0,0 +1,310 @@
+#include "dependency_graph.h"
+
+#include <algorithm>
+#include <cassert>
+
+DependencyGraph::DependencyGraph(std::pmr::memory_resource* resource)
+    : cells_(resource)
+    , free_nodes_(resource)
+    , order_(resource)
+    , marks_(resource)
+    , dependents_(resource)
+    , references_(resource)
+    , moved_entries_(resource)
+    , moved_overflow_(resource)
+    , stack_(resource)
+    , forward_(resource)
+    , backward_(resource)
+    , orders_(resource) {
+}
+
+template <typename Entry>
+std::uint32_t DependencyGraph::Adjacency<Entry>::Add(NodeId node, Entry entry) {
+    const auto idx = static_cast<std::uint32_t>(overflow.size());
+    assert(idx < OVERFLOW_BIT && "DependencyGraph err: too many edges");
+    overflow.push_back({entry, overflow_heads[node]});
+    overflow_heads[node] = idx;
+    return idx | OVERFLOW_BIT;
+}
+
+template <typename Entry>
+bool DependencyGraph::Adjacency<Entry>::Any(NodeId node) const {
+    if (node + 1 < offsets.size()) {
+        for (std::uint32_t slot = offsets[node]; slot < offsets[node + 1]; ++slot) {
+            if (entries[slot].node != NO_NODE) {
+                return true;
+            }
+        }
+    }
+    for (std::uint32_t idx = overflow_heads[node]; idx != NONE; idx = overflow[idx].next) {
+        if (overflow[idx].entry.node != NO_NODE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Entry>
+void DependencyGraph::Adjacency<Entry>::Clear(NodeId node) {
+    ForEach(node, [this](std::uint32_t slot, const Entry&) {
+        At(slot).node = NO_NODE;
+        ++tombstones;
+    });
+    overflow_heads[node] = NONE;
+}
+
+template <typename Entry>
+template <typename Fn>
+void DependencyGraph::Adjacency<Entry>::Compact(size_t node_count, Fn&& fn) {
+    std::pmr::memory_resource* resource = entries.get_allocator().resource();
+    std::pmr::vector<std::uint32_t> new_offsets(resource);
+    std::pmr::vector<Entry> new_entries(resource);
+    new_offsets.reserve(node_count + 1);
+    new_entries.reserve(entries.size() + overflow.size() - tombstones);
+    for (NodeId node = 0; node < node_count; ++node) {
+        new_offsets.push_back(static_cast<std::uint32_t>(new_entries.size()));
+        ForEach(node, [&](std::uint32_t slot, const Entry& entry) {
+            new_entries.push_back(entry);
+            fn(slot, static_cast<std::uint32_t>(new_entries.size() - 1), new_entries.back());
+        });
+    }
+    new_offsets.push_back(static_cast<std::uint32_t>(new_entries.size()));
+
+    offsets = std::move(new_offsets);
+    entries = std::move(new_entries);
+    overflow.clear();
+    overflow.shrink_to_fit();
+    overflow_heads.assign(node_count, NONE);
+    tombstones = 0;
+}
+
+DependencyGraph::NodeId DependencyGraph::AddNode(Cell* cell) {
+    // taken first: renumbering skips the free nodes
+    const std::uint32_t order = NextBackOrder();
+    if (!free_nodes_.empty()) {
+        const NodeId node = free_nodes_.back();
+        free_nodes_.pop_back();
+        cells_[node] = cell;
+        order_[node] = order;
+        return node;
+    }
+    cells_.push_back(cell);
+    order_.push_back(order);
+    marks_.push_back(0);
+    dependents_.overflow_heads.push_back(NONE);
+    references_.overflow_heads.push_back(NONE);
+    return static_cast<NodeId>(cells_.size() - 1);
+}
+
+void DependencyGraph::RemoveNode(NodeId node) {
+    dependents_.Clear(node);
+    references_.Clear(node);
+    cells_[node] = nullptr;
+    free_nodes_.push_back(node);
+}
+
+bool DependencyGraph::OrderEdge(NodeId from, NodeId to) {
+    if (from == to) {
+        return false;
+    }
+    if (order_[to] < order_[from]) {
+        return true;
+    }
+    // a node without references may go first and one without dependents
+    // last, that is how sheets are mostly filled
+    if (!references_.Any(to)) {
+        order_[to] = NextFrontOrder();
+        return true;
+    }
+    if (!dependents_.Any(from)) {
+        order_[from] = NextBackOrder();
+        return true;
+    }
+    return Reorder(from, to);
+}
+
+bool DependencyGraph::Reorder(NodeId from, NodeId to) {
+    const std::uint32_t lower = order_[from];
+    const std::uint32_t upper = order_[to];
+    const std::uint32_t mark = NextMark();
+
+    // the formulas depending on `from` that come before `to`; reaching `to`
+    // means that `to` already depends on `from`
+    bool cycle = false;
+    forward_.clear();
+    stack_.assign(1, from);
+    marks_[from] = mark;
+    while (!stack_.empty() && !cycle) {
+        const NodeId node = stack_.back();
+        stack_.pop_back();
+        forward_.push_back(node);
+        dependents_.ForEach(node, [&](std::uint32_t, const Dependent& dependent) {
+            if (dependent.node == to) {
+                cycle = true;
+            } else if (marks_[dependent.node] != mark && order_[dependent.node] < upper) {
+                marks_[dependent.node] = mark;
+                stack_.push_back(dependent.node);
+            }
+        });
+    }
+    if (cycle) {
+        return false;
+    }
+
+    // the cells `to` depends on that come after `from`
+    backward_.clear();
+    stack_.assign(1, to);
+    marks_[to] = mark;
+    while (!stack_.empty()) {
+        const NodeId node = stack_.back();
+        stack_.pop_back();
+        backward_.push_back(node);
+        references_.ForEach(node, [&](std::uint32_t, const Reference& ref) {
+            if (marks_[ref.node] != mark && order_[ref.node] > lower) {
+                marks_[ref.node] = mark;
+                stack_.push_back(ref.node);
+            }
+        });
+    }
+
+    // the same orders are handed out again, the backward region first
+    const auto by_order = [this](NodeId lhs, NodeId rhs) {
+        return order_[lhs] < order_[rhs];
+    };
+    std::sort(forward_.begin(), forward_.end(), by_order);
+    std::sort(backward_.begin(), backward_.end(), by_order);
+    orders_.clear();
+    for (const NodeId node : backward_) {
+        orders_.push_back(order_[node]);
+    }
+    for (const NodeId node : forward_) {
+        orders_.push_back(order_[node]);
+    }
+    std::sort(orders_.begin(), orders_.end());
+    size_t idx = 0;
+    for (const NodeId node : backward_) {
+        order_[node] = orders_[idx++];
+    }
+    for (const NodeId node : forward_) {
+        order_[node] = orders_[idx++];
+    }
+    return true;
+}
+
+std::uint32_t DependencyGraph::NextFrontOrder() {
+    if (next_front_order_ == 0) {
+        Renumber();
+    }
+    return next_front_order_--;
+}
+
+std::uint32_t DependencyGraph::NextBackOrder() {
+    if (next_back_order_ == ~std::uint32_t{0}) {
+        Renumber();
+    }
+    return next_back_order_++;
+}
+
+void DependencyGraph::Renumber() {
+    stack_.clear();
+    for (NodeId node = 0; node < cells_.size(); ++node) {
+        if (cells_[node] != nullptr) {
+            stack_.push_back(node);
+        }
+    }
+    std::sort(stack_.begin(), stack_.end(), [this](NodeId lhs, NodeId rhs) {
+        return order_[lhs] < order_[rhs];
+    });
+    std::uint32_t order = MIDDLE_ORDER - static_cast<std::uint32_t>(stack_.size() / 2);
+    next_front_order_ = order - 1;
+    for (const NodeId node : stack_) {
+        order_[node] = order++;
+    }
+    next_back_order_ = order;
+    stack_.clear();
+}
+
+std::uint32_t DependencyGraph::NextMark() {
+    if (++mark_ == 0) {
+        std::fill(marks_.begin(), marks_.end(), 0);
+        mark_ = 1;
+    }
+    return mark_;
+}
+
+void DependencyGraph::AddEdge(NodeId from, NodeId to) {
+    [[maybe_unused]] const bool acyclic = OrderEdge(from, to);
+    assert(acyclic && "DependencyGraph err: the edge closes a cycle");
+    const std::uint32_t slot = dependents_.Add(to, Dependent{from});
+    references_.Add(from, Reference{to, slot});
+    MaybeCompact();
+}
+
+void DependencyGraph::RemoveEdge(NodeId from, NodeId to) {
+    references_.ForEach(from, [this, to](std::uint32_t slot, const Reference& ref) {
+        if (ref.node == to) {
+            dependents_.At(ref.dependent_slot).node = NO_NODE;
+            ++dependents_.tombstones;
+            references_.At(slot).node = NO_NODE;
+            ++references_.tombstones;
+        }
+    });
+    MaybeCompact();
+}
+
+void DependencyGraph::ClearReferences(NodeId node) {
+    references_.ForEach(node, [this](std::uint32_t, const Reference& ref) {
+        dependents_.At(ref.dependent_slot).node = NO_NODE;
+        ++dependents_.tombstones;
+    });
+    references_.Clear(node);
+    MaybeCompact();
+}
+
+void DependencyGraph::RemoveDependents(NodeId node) {
+    dependents_.ForEach(node, [this, node](std::uint32_t, const Dependent& dependent) {
+        // a formula refers to a few cells, the opposite entry is searched
+        references_.ForEach(dependent.node, [this, node](std::uint32_t slot, const Reference& ref) {
+            if (ref.node == node) {
+                references_.At(slot).node = NO_NODE;
+                ++references_.tombstones;
+            }
+        });
+    });
+    dependents_.Clear(node);
+    MaybeCompact();
+}
+
+bool DependencyGraph::HasDependents(NodeId node) const {
+    return dependents_.Any(node);
+}
+
+void DependencyGraph::MaybeCompact() {
+    const size_t garbage = dependents_.overflow.size() + dependents_.tombstones;
+    if (garbage > std::max(MIN_COMPACTION, dependents_.entries.size() / 2)) {
+        Compact();
+    }
+}
+
+void DependencyGraph::Compact() {
+    // the references point at their dependent entries, so the dependents
+    // are moved first and their new slots are looked up after
+    moved_entries_.assign(dependents_.entries.size(), NONE);
+    moved_overflow_.assign(dependents_.overflow.size(), NONE);
+    dependents_.Compact(cells_.size(), [this](std::uint32_t old_slot, std::uint32_t new_slot,
+                                              Dependent&) {
+        if (old_slot & OVERFLOW_BIT) {
+            moved_overflow_[old_slot & ~OVERFLOW_BIT] = new_slot;
+        } else {
+            moved_entries_[old_slot] = new_slot;
+        }
+    });
+    references_.Compact(cells_.size(), [this](std::uint32_t, std::uint32_t, Reference& ref) {
+        const std::uint32_t old_slot = ref.dependent_slot;
+        ref.dependent_slot = old_slot & OVERFLOW_BIT ? moved_overflow_[old_slot & ~OVERFLOW_BIT]
+                                                     : moved_entries_[old_slot];
+        assert(ref.dependent_slot != NONE && "DependencyGraph err: reference without dependent");
+    });
+    moved_entries_.clear();
+    moved_overflow_.clear();
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+class Cell;
+
+// Dependency graph of the cells of a sheet. A cell gets a node on its first
+// edge. Both directions of an edge are kept: the references of a formula
+// and the dependents of a cell.
+// Each direction is compressed sparse rows: the edges of node n occupy
+// [offsets[n], offsets[n + 1]) of one array. Edges added since the last
+// compaction go to an overflow area, a linked list per node; removed edges
+// become tombstones. Once the overflow and the tombstones outgrow half of
+// the compacted edges, both directions are rewritten without them.
+// The nodes are kept in a topological order, a referenced cell before the
+// formulas referring to it. A new edge that breaks the order reorders only
+// the nodes between its ends (Pearce and Kelly), and a walk of the same
+// region finds the cycle the edge would close.
+class DependencyGraph {
+public:
+    using NodeId = std::uint32_t;
+    static constexpr NodeId NO_NODE = ~NodeId{0};
+
+    explicit DependencyGraph(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    DependencyGraph(const DependencyGraph&) = delete;
+    DependencyGraph& operator=(const DependencyGraph&) = delete;
+
+    NodeId AddNode(Cell* cell);
+    // drops the edges of the node from its own lists, the other ends must
+    // be gone already unless the whole graph is being destroyed
+    void RemoveNode(NodeId node);
+
+    // false if the formula of node `from` referring to the cell of node `to`
+    // would close a cycle; otherwise puts `to` before `from` in the order,
+    // the edge itself is added by AddEdge
+    bool OrderEdge(NodeId from, NodeId to);
+    // the formula of node `from` refers to the cell of node `to`; the edge
+    // must not be in the graph and must not close a cycle
+    void AddEdge(NodeId from, NodeId to);
+    // O(references of `from`)
+    void RemoveEdge(NodeId from, NodeId to);
+    // drops the references of the node
+    void ClearReferences(NodeId node);
+    // drops the dependents of the node, fn(cell) is called for each of them
+    template <typename Fn>
+    void ClearDependents(NodeId node, Fn&& fn);
+
+    // fn(cell) for every cell the formula of the node refers to
+    template <typename Fn>
+    void ForEachReference(NodeId node, Fn&& fn) const;
+    // fn(cell) for every formula referring to the cell of the node
+    template <typename Fn>
+    void ForEachDependent(NodeId node, Fn&& fn) const;
+    bool HasDependents(NodeId node) const;
+
+private:
+    static constexpr std::uint32_t NONE = ~std::uint32_t{0};
+    // slots of overflow entries have the high bit set
+    static constexpr std::uint32_t OVERFLOW_BIT = std::uint32_t{1} << 31;
+    // the overflow may grow to this many entries before the first compaction
+    static constexpr size_t MIN_COMPACTION = 1024;
+    // orders of new nodes grow from here in both directions
+    static constexpr std::uint32_t MIDDLE_ORDER = std::uint32_t{1} << 31;
+
+    struct Dependent {
+        NodeId node;
+    };
+    struct Reference {
+        NodeId node;
+        std::uint32_t dependent_slot;  // of the opposite entry in the dependents
+    };
+
+    template <typename Entry>
+    struct Adjacency {
+        struct Overflow {
+            Entry entry;
+            std::uint32_t next;
+        };
+
+        explicit Adjacency(std::pmr::memory_resource* resource)
+            : offsets(resource)
+            , entries(resource)
+            , overflow(resource)
+            , overflow_heads(resource) {
+        }
+
+        // the node of a removed edge is NO_NODE
+        Entry& At(std::uint32_t slot) {
+            return slot & OVERFLOW_BIT ? overflow[slot & ~OVERFLOW_BIT].entry : entries[slot];
+        }
+        // returns the slot of the new entry
+        std::uint32_t Add(NodeId node, Entry entry);
+        // calls fn(slot, entry) for every live entry of the node
+        template <typename Fn>
+        void ForEach(NodeId node, Fn&& fn) const;
+        bool Any(NodeId node) const;
+        void Clear(NodeId node);
+        // moves the live entries of every node into the compacted arrays,
+        // fn(old_slot, new_slot, entry) is called for each of them
+        template <typename Fn>
+        void Compact(size_t node_count, Fn&& fn);
+
+        std::pmr::vector<std::uint32_t> offsets;  // one more than the compacted nodes
+        std::pmr::vector<Entry> entries;
+        std::pmr::vector<Overflow> overflow;
+        std::pmr::vector<std::uint32_t> overflow_heads;  // per node
+        size_t tombstones = 0;
+    };
+
+    void RemoveDependents(NodeId node);
+    void MaybeCompact();
+    void Compact();
+
+    // orders before and after those of all nodes
+    std::uint32_t NextFrontOrder();
+    std::uint32_t NextBackOrder();
+    // renumbers the nodes around MIDDLE_ORDER when the orders run out
+    void Renumber();
+    std::uint32_t NextMark();
+    // the edge breaks the order: walks the dependents of `from` and the
+    // references of `to` between their orders and swaps the two regions
+    bool Reorder(NodeId from, NodeId to);
+
+    std::pmr::vector<Cell*> cells_;  // by node
+    std::pmr::vector<NodeId> free_nodes_;
+    std::pmr::vector<std::uint32_t> order_;  // by node
+    std::uint32_t next_front_order_ = MIDDLE_ORDER - 1;
+    std::uint32_t next_back_order_ = MIDDLE_ORDER;
+    // visited nodes of Reorder have the current mark
+    std::pmr::vector<std::uint32_t> marks_;
+    std::uint32_t mark_ = 0;
+    Adjacency<Dependent> dependents_;
+    Adjacency<Reference> references_;
+    // reused by Compact: new slots of the dependents by old slot
+    std::pmr::vector<std::uint32_t> moved_entries_;
+    std::pmr::vector<std::uint32_t> moved_overflow_;
+    // reused by Reorder
+    std::pmr::vector<NodeId> stack_;
+    std::pmr::vector<NodeId> forward_;
+    std::pmr::vector<NodeId> backward_;
+    std::pmr::vector<std::uint32_t> orders_;
+};
+
+template <typename Entry>
+template <typename Fn>
+void DependencyGraph::Adjacency<Entry>::ForEach(NodeId node, Fn&& fn) const {
+    if (node + 1 < offsets.size()) {
+        for (std::uint32_t slot = offsets[node]; slot < offsets[node + 1]; ++slot) {
+            if (entries[slot].node != NO_NODE) {
+                fn(slot, entries[slot]);
+            }
+        }
+    }
+    for (std::uint32_t idx = overflow_heads[node]; idx != NONE; idx = overflow[idx].next) {
+        if (overflow[idx].entry.node != NO_NODE) {
+            fn(idx | OVERFLOW_BIT, overflow[idx].entry);
+        }
+    }
+}
+
+template <typename Fn>
+void DependencyGraph::ForEachReference(NodeId node, Fn&& fn) const {
+    references_.ForEach(node, [this, &fn](std::uint32_t, const Reference& ref) {
+        fn(cells_[ref.node]);
+    });
+}
+
+template <typename Fn>
+void DependencyGraph::ForEachDependent(NodeId node, Fn&& fn) const {
+    dependents_.ForEach(node, [this, &fn](std::uint32_t, const Dependent& dependent) {
+        fn(cells_[dependent.node]);
+    });
+}
+
+template <typename Fn>
+void DependencyGraph::ClearDependents(NodeId node, Fn&& fn) {
+    ForEachDependent(node, fn);
+    RemoveDependents(node);
+}
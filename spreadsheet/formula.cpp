@@ -5,6 +5,9 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstddef>
+#include <memory>
+#include <new>
 #include <set>
 #include <sstream>
 
@@ -40,23 +43,46 @@ std::ostream& operator<<(std::ostream& output, FormulaError fe) {
 }
 
 namespace {
+// what a formula block starts with
+struct BlockHeader {
+    std::pmr::memory_resource* resource;
+    size_t size;
+};
+
+constexpr size_t BLOCK_ALIGN = alignof(std::max_align_t);
+
+constexpr size_t AlignUp(size_t size) {
+    return (size + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+}
+
+constexpr size_t HEADER_SIZE = AlignUp(sizeof(BlockHeader));
+
+// A formula and its AST are one block of the memory resource: a header
+// keeping the resource, the formula object and the storage of the AST.
 class Formula : public FormulaInterface {
 public:
-// Реализуйте следующие методы:
-    explicit Formula(std::string expression) try
-        : ast_(ParseFormulaAST(expression)) {}
-    catch (const FormulaException& exc) {
-        throw exc;
+    static std::unique_ptr<FormulaInterface> Create(const std::string& expression,
+                                                    std::pmr::memory_resource* resource) {
+        FormulaDraft draft;
+        ParseFormulaAST(expression, draft);
+
+        constexpr size_t OBJECT_SIZE = AlignUp(sizeof(Formula));
+        const size_t size = HEADER_SIZE + OBJECT_SIZE + draft.GetStorageSize();
+        auto block = static_cast<std::byte*>(resource->allocate(size, BLOCK_ALIGN));
+        new (block) BlockHeader{resource, size};
+        FormulaAST ast = draft.Place(block + HEADER_SIZE + OBJECT_SIZE);
+        return std::unique_ptr<FormulaInterface>(new (block + HEADER_SIZE) Formula(ast));
+    }
+
+    // returns the whole block to its resource
+    static void operator delete(void* ptr) {
+        std::byte* block = static_cast<std::byte*>(ptr) - HEADER_SIZE;
+        const BlockHeader header = *std::launder(reinterpret_cast<BlockHeader*>(block));
+        header.resource->deallocate(block, header.size, BLOCK_ALIGN);
     }
 
     Value Evaluate(const SheetInterface& sheet) const override {
-        Value val;
-        try {
-            val = ast_.Execute(sheet);
-        } catch (const FormulaError& exc) {
-            val = exc;
-        }
-        return val;
+        return ast_.Execute(sheet);
     }
     
     std::string GetExpression() const override {
@@ -69,20 +95,30 @@ public:
     // формулы. Список отсортирован по возрастанию и не содержит повторяющихся
     // ячеек.
     std::vector<Position> GetReferencedCells() const override {
-        std::vector<Position> list{ast_.GetCells().begin(), ast_.GetCells().end()};
-        list.erase(std::unique(list.begin(),list.end()),list.end());
-        std::sort(list.begin(), list.end());
-        return list;
+        return {ast_.CellsBegin(), ast_.CellsEnd()};
+    }
+
+    void BindCell(Position pos, const CellInterface* cell) override {
+        ast_.BindCell(pos, cell);
     }
 
 private:
+    explicit Formula(FormulaAST ast) noexcept
+        : ast_(ast) {
+    }
+
     FormulaAST ast_;
 };
 }  // namespace
 
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression) {
+    return ParseFormula(std::move(expression), std::pmr::get_default_resource());
+}
+
+std::unique_ptr<FormulaInterface> ParseFormula(std::string expression,
+                                               std::pmr::memory_resource* resource) {
     try {
-        return std::make_unique<Formula>(std::move(expression));
+        return Formula::Create(expression, resource);
     } catch (...) {
         throw FormulaException("Parsing formula from expression was failure"s);
     }
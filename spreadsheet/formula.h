@@ -3,6 +3,7 @@
 #include "common.h"
 
 #include <memory>
+#include <memory_resource>
 #include <vector>
 
 // Формула, позволяющая вычислять и обновлять арифметическое выражение.
@@ -27,15 +28,24 @@ public:
     virtual Value Evaluate(const SheetInterface& sheet) const = 0;
 
     // Возвращает выражение, которое описывает формулу.
-    // Не содержит пробелов и лишних скобок.
+    // Не содержит пробелов и лишних скобок. Константы и тождества, которые
+    // упрощаются при вычислении (2*3*A1+0), остаются такими, как записаны.
     virtual std::string GetExpression() const = 0;
 
     // Возвращает список ячеек, которые непосредственно задействованы в вычислении
     // формулы. Список отсортирован по возрастанию и не содержит повторяющихся
     // ячеек.
     virtual std::vector<Position> GetReferencedCells() const = 0;
+
+    // Связывает ячейку, на которую ссылается формула, с объектом ячейки
+    // (nullptr, если ячейки нет). Связанная формула читает значения через
+    // связи, не ища ячейки в таблице, поэтому связываются все ячейки сразу.
+    virtual void BindCell(Position pos, const CellInterface* cell) = 0;
 };
 
 // Парсит переданное выражение и возвращает объект формулы.
 // Бросает FormulaException в случае, если формула синтаксически некорректна.
 std::unique_ptr<FormulaInterface> ParseFormula(std::string expression);
+// То же, но формула выделяется одним блоком из переданного ресурса памяти.
+std::unique_ptr<FormulaInterface> ParseFormula(std::string expression,
+                                               std::pmr::memory_resource* resource);
@@ -0,0 +1,285 @@
+#include "formula_program.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+double Apply(FormulaProgram::OpCode op, double lhs, double rhs) {
+    using OpCode = FormulaProgram::OpCode;
+    switch (op) {
+        case OpCode::Add:
+            return lhs + rhs;
+        case OpCode::Subtract:
+            return lhs - rhs;
+        case OpCode::Multiply:
+            return lhs * rhs;
+        default:
+            assert(op == OpCode::Divide);
+            return lhs / rhs;
+    }
+}
+
+FormulaProgram::OpCode WithConstant(FormulaProgram::OpCode op) {
+    using OpCode = FormulaProgram::OpCode;
+    switch (op) {
+        case OpCode::Add:
+            return OpCode::AddConst;
+        case OpCode::Subtract:
+            return OpCode::SubtractConst;
+        case OpCode::Multiply:
+            return OpCode::MultiplyConst;
+        default:
+            assert(op == OpCode::Divide);
+            return OpCode::DivideConst;
+    }
+}
+
+// x op value == x for every x, the sign of a zero included
+bool IsIdentity(FormulaProgram::OpCode op, double value) {
+    using OpCode = FormulaProgram::OpCode;
+    switch (op) {
+        case OpCode::Add:
+            return value == 0 && std::signbit(value);
+        case OpCode::Subtract:
+            return value == 0 && !std::signbit(value);
+        default:
+            return value == 1;
+    }
+}
+
+bool UsesConstant(FormulaProgram::OpCode op) {
+    using OpCode = FormulaProgram::OpCode;
+    return op == OpCode::PushConst || op >= OpCode::AddConst;
+}
+
+size_t AlignUp(size_t size) {
+    constexpr size_t ALIGN = alignof(std::max_align_t);
+    return (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+}  // namespace
+
+FormulaCompiler::FormulaCompiler(std::pmr::memory_resource* scratch)
+    : code_(scratch)
+    , constants_(scratch)
+    , cells_(scratch)
+    , starts_(scratch) {
+}
+
+void FormulaCompiler::PushValue(Instruction instruction) {
+    starts_.push_back(static_cast<std::uint32_t>(code_.size()));
+    code_.push_back(instruction);
+    max_depth_ = std::max(max_depth_, static_cast<std::uint32_t>(starts_.size()));
+}
+
+void FormulaCompiler::PushConst(double value) {
+    PushValue({OpCode::PushConst, static_cast<std::uint32_t>(constants_.size())});
+    constants_.push_back(value);
+}
+
+void FormulaCompiler::LoadCell(Position pos) {
+    assert(pos.IsValid());
+    PushValue({OpCode::LoadCell, static_cast<std::uint32_t>(cells_.size())});
+    cells_.push_back(pos);
+}
+
+bool FormulaCompiler::IsConstant(size_t begin, size_t end) const {
+    return end - begin == 1 && code_[begin].op == OpCode::PushConst;
+}
+
+void FormulaCompiler::Emit(OpCode op) {
+    if (op == OpCode::Negate) {
+        EmitNegate();
+    } else {
+        EmitBinary(op);
+    }
+}
+
+void FormulaCompiler::EmitNegate() {
+    assert(!starts_.empty());
+    Instruction& last = code_.back();
+    if (last.op == OpCode::Negate) {
+        // the last operator of a value is its root: --x is x
+        code_.pop_back();
+    } else if (IsConstant(starts_.back(), code_.size())) {
+        // every constant instruction has a slot of its own
+        constants_[last.operand] = -constants_[last.operand];
+    } else {
+        code_.push_back({OpCode::Negate, 0});
+    }
+}
+
+void FormulaCompiler::EmitBinary(OpCode op) {
+    assert(op >= OpCode::Add && op <= OpCode::Divide && starts_.size() >= 2);
+    const size_t rhs_start = starts_.back();
+    starts_.pop_back();
+    const size_t lhs_start = starts_.back();  // the start of the result too
+    const bool lhs_constant = IsConstant(lhs_start, rhs_start);
+    bool rhs_constant = IsConstant(rhs_start, code_.size());
+
+    if (lhs_constant && rhs_constant) {
+        const double value = Apply(op, constants_[code_[lhs_start].operand],
+                                   constants_[code_[rhs_start].operand]);
+        // an error is left for the execution to report in its turn
+        if (std::isfinite(value)) {
+            constants_[code_[lhs_start].operand] = value;
+            code_.pop_back();
+            return;
+        }
+    } else if (lhs_constant && (op == OpCode::Add || op == OpCode::Multiply)) {
+        // a constant cannot fail, so the errors are met in the same order
+        const Instruction constant = code_[lhs_start];
+        code_.erase(code_.begin() + lhs_start);
+        code_.push_back(constant);
+        rhs_constant = true;
+    }
+
+    if (rhs_constant) {
+        const Instruction constant = code_.back();
+        code_.pop_back();
+        if (!IsIdentity(op, constants_[constant.operand])) {
+            code_.push_back({WithConstant(op), constant.operand});
+        }
+        return;
+    }
+    code_.push_back({op, 0});
+}
+
+void FormulaCompiler::Finish() {
+    assert(starts_.size() == 1 && "FormulaCompiler err: the stack must end with the result");
+    starts_.clear();
+
+    // LoadCell pushed a position per reference, the pool keeps one of each
+    std::pmr::vector<Position> sorted(cells_, cells_.get_allocator());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    // the constants of the folded operands are left out
+    std::pmr::vector<double> constants(constants_.get_allocator());
+    for (Instruction& instruction : code_) {
+        if (instruction.op == OpCode::LoadCell) {
+            const Position pos = cells_[instruction.operand];
+            instruction.operand = static_cast<std::uint32_t>(
+                std::lower_bound(sorted.begin(), sorted.end(), pos) - sorted.begin());
+        } else if (UsesConstant(instruction.op)) {
+            constants.push_back(constants_[instruction.operand]);
+            instruction.operand = static_cast<std::uint32_t>(constants.size() - 1);
+        }
+    }
+    cells_ = std::move(sorted);
+    constants_ = std::move(constants);
+}
+
+size_t FormulaCompiler::GetStorageSize() const {
+    return AlignUp(cells_.size() * sizeof(const CellInterface*) + constants_.size() * sizeof(double)
+                   + code_.size() * sizeof(Instruction) + cells_.size() * sizeof(Position));
+}
+
+FormulaProgram FormulaCompiler::Place(std::byte* storage) const {
+    assert(starts_.empty() && "FormulaCompiler err: the program is not finished");
+    // the arrays go in the order of their alignment
+    auto bound_cells = reinterpret_cast<const CellInterface**>(storage);
+    std::fill_n(bound_cells, cells_.size(), nullptr);
+    auto constants = reinterpret_cast<double*>(bound_cells + cells_.size());
+    std::copy(constants_.begin(), constants_.end(), constants);
+    auto code = reinterpret_cast<Instruction*>(constants + constants_.size());
+    std::copy(code_.begin(), code_.end(), code);
+    auto cells = reinterpret_cast<Position*>(code + code_.size());
+    std::copy(cells_.begin(), cells_.end(), cells);
+
+    FormulaProgram program;
+    program.bound_cells_ = bound_cells;
+    program.constants_ = constants;
+    program.code_ = code;
+    program.cells_ = cells;
+    program.code_size_ = static_cast<std::uint32_t>(code_.size());
+    program.cell_count_ = static_cast<std::uint32_t>(cells_.size());
+    program.max_depth_ = max_depth_;
+    return program;
+}
+
+void FormulaProgram::BindCell(Position pos, const CellInterface* cell) {
+    const Position* it = std::lower_bound(CellsBegin(), CellsEnd(), pos);
+    assert(it != CellsEnd() && *it == pos && "FormulaProgram err: the position is not referenced");
+    bound_cells_[it - cells_] = cell;
+    bound_ = true;
+}
+
+const Position* FormulaProgram::CellsBegin() const {
+    return cells_;
+}
+
+const Position* FormulaProgram::CellsEnd() const {
+    return cells_ + cell_count_;
+}
+
+std::variant<double, FormulaError> FormulaProgram::Execute(const SheetInterface& sheet) const {
+    double small_stack[SMALL_STACK];
+    small_stack[0] = 0;  // the rest is written before it is read
+    std::vector<double> large_stack;
+    double* stack = small_stack;
+    if (max_depth_ > SMALL_STACK) {
+        large_stack.resize(max_depth_);
+        stack = large_stack.data();
+    }
+
+    double* top = stack;  // one past the top value
+    for (const Instruction* instruction = code_; instruction != code_ + code_size_; ++instruction) {
+        switch (instruction->op) {
+            case OpCode::PushConst:
+                *top++ = constants_[instruction->operand];
+                break;
+            case OpCode::LoadCell: {
+                const CellInterface* cell = bound_
+                                            ? bound_cells_[instruction->operand]
+                                            : sheet.GetCell(cells_[instruction->operand]);
+                if (cell == nullptr) {
+                    *top++ = 0;
+                    break;
+                }
+                const std::variant<double, FormulaError> value = cell->GetNumericValue();
+                if (const FormulaError* error = std::get_if<FormulaError>(&value)) {
+                    return *error;
+                }
+                *top++ = std::get<double>(value);
+                break;
+            }
+            case OpCode::Add:
+                --top;
+                top[-1] += top[0];
+                break;
+            case OpCode::Subtract:
+                --top;
+                top[-1] -= top[0];
+                break;
+            case OpCode::Multiply:
+                --top;
+                top[-1] *= top[0];
+                break;
+            case OpCode::Divide:
+                --top;
+                top[-1] /= top[0];
+                break;
+            case OpCode::Negate:
+                top[-1] = -top[-1];
+                break;
+            case OpCode::AddConst:
+                top[-1] += constants_[instruction->operand];
+                break;
+            case OpCode::SubtractConst:
+                top[-1] -= constants_[instruction->operand];
+                break;
+            case OpCode::MultiplyConst:
+                top[-1] *= constants_[instruction->operand];
+                break;
+            case OpCode::DivideConst:
+                top[-1] /= constants_[instruction->operand];
+                break;
+        }
+        // constants and cell values are finite, so only an operator can
+        // make the top infinite or NaN
+        if (!std::isfinite(top[-1])) {
+            return FormulaError(FormulaError::Category::Arithmetic);
+        }
+    }
+    return stack[0];
+}
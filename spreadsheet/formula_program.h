@@ -0,0 +1,112 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <variant>
+#include <vector>
+
+// A formula compiled into postfix bytecode for a stack machine. Operands of
+// the instructions index the constant and cell pools, so an instruction is
+// 8 bytes and the code is one contiguous array.
+// The positions of the cell pool can be bound to the cells there, a bound
+// program reads its inputs through the bindings instead of the sheet.
+// The code is simplified while it is emitted: operators over constants are
+// folded unless the result is an error, a constant operand of + and * goes
+// to the right, and a constant right operand is fused into its operator,
+// which is dropped for the identities x-0, x+(-0), x*1 and x/1. The result
+// is exactly that of the code as written; x+0 is kept, it turns -0 into 0.
+// A program does not own its arrays, FormulaCompiler places them into the
+// storage of the formula.
+class FormulaProgram {
+public:
+    enum class OpCode : std::uint8_t {
+        PushConst,  // pushes constants_[operand]
+        LoadCell,   // pushes the numeric value of the cell at cells_[operand]
+        Add,        // pop rhs and lhs, push lhs op rhs, an infinite or NaN
+        Subtract,   // result is an arithmetic error
+        Multiply,
+        Divide,
+        Negate,     // negates the top of the stack
+        AddConst,   // the operator of the top and constants_[operand]
+        SubtractConst,
+        MultiplyConst,
+        DivideConst,
+    };
+
+    struct Instruction {
+        OpCode op;
+        std::uint32_t operand;
+    };
+
+    FormulaProgram() = default;
+
+    // binds a referenced position to its cell, nullptr if there is none;
+    // once a position is bound the rest read as empty until they are bound
+    void BindCell(Position pos, const CellInterface* cell);
+
+    // the first error met, of a referenced cell or of the arithmetic, is
+    // the result
+    std::variant<double, FormulaError> Execute(const SheetInterface& sheet) const;
+
+    // the referenced positions, sorted and without repeats
+    const Position* CellsBegin() const;
+    const Position* CellsEnd() const;
+
+private:
+    friend class FormulaCompiler;
+
+    // programs needing a deeper stack allocate it on every execution
+    static constexpr size_t SMALL_STACK = 32;
+
+    // the arrays live in the storage given to FormulaCompiler::Place
+    const CellInterface** bound_cells_ = nullptr;
+    const double* constants_ = nullptr;
+    const Instruction* code_ = nullptr;
+    const Position* cells_ = nullptr;
+    std::uint32_t code_size_ = 0;
+    std::uint32_t cell_count_ = 0;
+    std::uint32_t max_depth_ = 0;
+    bool bound_ = false;
+};
+
+// Emits the code of a FormulaProgram into growing arrays of a scratch memory
+// resource, then places the finished program into storage of a known size,
+// so that a formula keeps all of its arrays in one block.
+class FormulaCompiler {
+public:
+    explicit FormulaCompiler(std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+
+    void PushConst(double value);
+    void LoadCell(Position pos);
+    // Add, Subtract, Multiply, Divide or Negate over the operands emitted
+    // last
+    void Emit(FormulaProgram::OpCode op);
+    // sorts the cell pool and drops the constants of the folded operands
+    void Finish();
+
+    // the bytes Place needs, a multiple of alignof(std::max_align_t)
+    size_t GetStorageSize() const;
+    // copies the finished program into storage aligned to
+    // alignof(std::max_align_t); the program refers to it
+    FormulaProgram Place(std::byte* storage) const;
+
+private:
+    using Instruction = FormulaProgram::Instruction;
+    using OpCode = FormulaProgram::OpCode;
+
+    void EmitBinary(OpCode op);
+    void EmitNegate();
+    // whether the code of [begin, end) is a single PushConst
+    bool IsConstant(size_t begin, size_t end) const;
+    void PushValue(Instruction instruction);
+
+    std::pmr::vector<Instruction> code_;
+    std::pmr::vector<double> constants_;
+    std::pmr::vector<Position> cells_;  // sorted, without repeats once finished
+    // while emitting: where the code of each value on the stack starts
+    std::pmr::vector<std::uint32_t> starts_;
+    std::uint32_t max_depth_ = 0;
+};
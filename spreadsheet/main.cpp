@@ -2,8 +2,16 @@
 
 #include "common.h"
 #include "formula.h"
+#include "sheet.h"
 #include "test_runner_p.h"
 
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <set>
+
 inline std::ostream& operator<<(std::ostream& output, Position pos) {
     return output << "(" << pos.row << ", " << pos.col << ")";
 }
@@ -25,6 +33,15 @@ inline std::ostream& operator<<(std::ostream& output, const CellInterface::Value
     return output;
 }
 
+inline std::ostream& operator<<(std::ostream& output, const CellInterface::ValueView& value) {
+    std::visit(
+        [&](const auto& x) {
+            output << x;
+        },
+        value);
+    return output;
+}
+
 namespace {
 
 void TestPositionAndStringConversion() {
@@ -245,6 +262,164 @@ void TestErrorArithmetic() {
     }
 }
 
+void TestDeepExpressions() {
+    auto sheet = CreateSheet();
+    // nested to the right, each operand waits on the stack
+    std::string text = "=";
+    for (int i = 0; i < 100; ++i) {
+        text += "B1+(";
+    }
+    text += "1" + std::string(100, ')');
+    sheet->SetCell("B1"_pos, "2");
+    sheet->SetCell("A1"_pos, text);
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(), CellInterface::Value(201.0));
+    sheet->SetCell("B1"_pos, "=1/0");
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError::Category::Arithmetic));
+
+    // an infinite intermediate value is an error even if the result is not
+    sheet->SetCell("A2"_pos, "=1/(1e+200*1e+200)");
+    ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError::Category::Arithmetic));
+    sheet->SetCell("A2"_pos, "=-(-(-3))*--2");
+    ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValue(), CellInterface::Value(-6.0));
+}
+
+// counts the live blocks and bytes allocated through it
+class BlockCountingResource : public std::pmr::memory_resource {
+public:
+    size_t blocks = 0;
+    size_t bytes = 0;
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        ++blocks;
+        bytes += size;
+        return std::pmr::get_default_resource()->allocate(size, alignment);
+    }
+    void do_deallocate(void* ptr, size_t size, size_t alignment) override {
+        --blocks;
+        bytes -= size;
+        std::pmr::get_default_resource()->deallocate(ptr, size, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+void TestFormulaBlock() {
+    BlockCountingResource resource;
+    {
+        // the formula object, its nodes, code, constants and positions
+        auto small = ParseFormula("(A1+B1)*2/C1", &resource);
+        ASSERT_EQUAL(resource.blocks, 1u);
+        ASSERT(resource.bytes <= 320);
+
+        std::string wide = "A1";
+        for (int col = 1; col < 64; ++col) {
+            wide += "+" + Position{0, col}.ToString();
+        }
+        auto large = ParseFormula(wide, &resource);
+        ASSERT_EQUAL(resource.blocks, 2u);
+        // 127 nodes of 16 bytes, 127 instructions and 64 positions and
+        // bindings of 8 bytes
+        ASSERT(resource.bytes <= 320 + 127 * 16 + 127 * 8 + 64 * 16 + 128);
+        ASSERT_EQUAL(large->GetReferencedCells().size(), 64u);
+        ASSERT_EQUAL(large->GetExpression(), wide);
+    }
+    ASSERT_EQUAL(resource.blocks, 0u);
+    ASSERT_EQUAL(resource.bytes, 0u);
+
+    try {
+        ParseFormula("1+", &resource);
+        ASSERT(false);
+    } catch (const FormulaException&) {
+    }
+    ASSERT_EQUAL(resource.blocks, 0u);
+}
+
+void TestConstantFolding() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "5");
+    sheet->SetCell("B2"_pos, "4");
+    sheet->SetCell("C1"_pos, "=2*3*A1+0");
+    sheet->SetCell("C2"_pos, "=(1+2)/(4-1)*B2");
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetValue(), CellInterface::Value(30.0));
+    ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetValue(), CellInterface::Value(4.0));
+    // the expression is kept as written
+    ASSERT_EQUAL(sheet->GetCell("C1"_pos)->GetText(), "=2*3*A1+0");
+    ASSERT_EQUAL(sheet->GetCell("C2"_pos)->GetText(), "=(1+2)/(4-1)*B2");
+
+    // folded errors are reported when the execution gets to them
+    sheet->SetCell("C3"_pos, "=A1/(2-2)");
+    ASSERT_EQUAL(sheet->GetCell("C3"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError::Category::Arithmetic));
+    sheet->SetCell("A1"_pos, "x");
+    sheet->SetCell("C3"_pos, "=A1+1/0");
+    ASSERT_EQUAL(sheet->GetCell("C3"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError::Category::Value));
+
+    // random expressions against copies with the constants in cells, which
+    // cannot be folded; D1 holds -0 to catch identities that lose its sign
+    Sheet cells;
+    const std::vector<std::string> constants{"0", "1", "2", "3"};
+    for (size_t k = 0; k < constants.size(); ++k) {
+        cells.SetCell({0, static_cast<int>(10 + k)}, constants[k]);
+    }
+    cells.SetCell("A1"_pos, "7");
+    cells.SetCell("B1"_pos, "0");
+    cells.SetCell("C1"_pos, "2");
+    cells.SetCell("D1"_pos, "=-0");
+    std::mt19937 gen(17);
+    std::uniform_int_distribution<int> pick(0, 9);
+    std::uniform_int_distribution<size_t> constant(0, constants.size() - 1);
+    const std::vector<std::string> variables{"A1", "B1", "C1", "D1"};
+    std::function<void(int, std::string&, std::string&)> generate =
+        [&](int depth, std::string& folded, std::string& unfolded) {
+            const int kind = depth == 0 ? pick(gen) % 2 : pick(gen);
+            if (kind == 0) {
+                const size_t k = constant(gen);
+                folded += constants[k];
+                unfolded += Position{0, static_cast<int>(10 + k)}.ToString();
+            } else if (kind == 1) {
+                const std::string& name = variables[pick(gen) % variables.size()];
+                folded += name;
+                unfolded += name;
+            } else if (kind == 2) {
+                const std::string sign = pick(gen) % 2 ? "-" : "+";
+                folded += sign + "(";
+                unfolded += sign + "(";
+                generate(depth - 1, folded, unfolded);
+                folded += ")";
+                unfolded += ")";
+            } else {
+                const std::string op(1, "+-*/"[pick(gen) % 4]);
+                folded += "(";
+                unfolded += "(";
+                generate(depth - 1, folded, unfolded);
+                folded += ")" + op + "(";
+                unfolded += ")" + op + "(";
+                generate(depth - 1, folded, unfolded);
+                folded += ")";
+                unfolded += ")";
+            }
+        };
+    for (int i = 0; i < 5000; ++i) {
+        std::string folded;
+        std::string unfolded;
+        generate(4, folded, unfolded);
+        cells.SetCell("E1"_pos, "=" + folded);
+        cells.SetCell("E2"_pos, "=" + unfolded);
+        const CellInterface::Value expected = cells.GetCell("E2"_pos)->GetValue();
+        const CellInterface::Value value = cells.GetCell("E1"_pos)->GetValue();
+        ASSERT_EQUAL(value, expected);
+        if (std::holds_alternative<double>(value)) {
+            ASSERT_EQUAL(std::signbit(std::get<double>(value)),
+                         std::signbit(std::get<double>(expected)));
+        }
+    }
+}
+
 void TestEmptyCellTreatedAsZero() {
     auto sheet = CreateSheet();
     sheet->SetCell("A1"_pos, "=B2");
@@ -288,6 +463,778 @@ void TestPrint() {
     ASSERT_EQUAL(values.str(), "\t\nmeow\t35\n");
 }
 
+void TestPrintAcrossTiles() {
+    for (auto kind : {CellStorageKind::Tiled, CellStorageKind::Hashed}) {
+        auto sheet = CreateSheet(SheetOptions{kind});
+        sheet->SetCell(Position{0, 0}, "a");
+        sheet->SetCell(Position{1, 64}, "b");
+        sheet->SetCell(Position{65, 1}, "=2");
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{66, 65}));
+        ASSERT_EQUAL(sheet->GetCell(Position{1, 64})->GetText(), "b");
+        ASSERT(sheet->GetCell(Position{1, 63}) == nullptr);
+
+        sheet->ClearCell(Position{65, 1});
+        ASSERT(sheet->GetCell(Position{65, 1}) == nullptr);
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{2, 65}));
+
+        std::ostringstream values;
+        sheet->PrintValues(values);
+        const std::string tabs(63, '\t');
+        ASSERT_EQUAL(values.str(), "a" + tabs + "\t\n" + tabs + "\tb\n");
+    }
+}
+
+void TestStorageRandomOperations() {
+    for (auto kind : {CellStorageKind::Tiled, CellStorageKind::Hashed}) {
+        auto sheet = CreateSheet(SheetOptions{kind});
+        std::map<Position, std::string> expected;
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<int> coord(0, 199);
+        for (int i = 0; i < 20000; ++i) {
+            Position pos{coord(gen), coord(gen)};
+            if (gen() % 3 == 0) {
+                sheet->ClearCell(pos);
+                expected.erase(pos);
+            } else {
+                sheet->SetCell(pos, pos.ToString());
+                expected[pos] = pos.ToString();
+            }
+        }
+        for (int row = 0; row < 200; ++row) {
+            for (int col = 0; col < 200; ++col) {
+                const CellInterface* cell = sheet->GetCell({row, col});
+                auto it = expected.find({row, col});
+                ASSERT_EQUAL(cell != nullptr, it != expected.end());
+                if (cell != nullptr) {
+                    ASSERT_EQUAL(cell->GetText(), it->second);
+                }
+            }
+        }
+
+        auto it = expected.begin();
+        static_cast<Sheet&>(*sheet).ForEachCell([&](Position pos, const CellInterface& cell) {
+            ASSERT(it != expected.end());
+            ASSERT_EQUAL(pos, it->first);
+            ASSERT_EQUAL(cell.GetText(), it->second);
+            ++it;
+        });
+        ASSERT(it == expected.end());
+    }
+}
+
+void TestForEachInRange() {
+    for (auto kind : {CellStorageKind::Tiled, CellStorageKind::Hashed}) {
+        Sheet sheet(SheetOptions{kind});
+        std::mt19937 gen(11);
+        std::uniform_int_distribution<int> coord(0, 299);
+        for (int i = 0; i < 5000; ++i) {
+            sheet.SetCell({coord(gen), coord(gen)}, "x");
+        }
+
+        for (int i = 0; i < 50; ++i) {
+            Position a{coord(gen), coord(gen)};
+            Position b{coord(gen), coord(gen)};
+            Position top_left{std::min(a.row, b.row), std::min(a.col, b.col)};
+            Position bottom_right{std::max(a.row, b.row), std::max(a.col, b.col)};
+
+            std::vector<Position> expected;
+            for (int row = top_left.row; row <= bottom_right.row; ++row) {
+                for (int col = top_left.col; col <= bottom_right.col; ++col) {
+                    if (sheet.GetCell({row, col}) != nullptr) {
+                        expected.push_back({row, col});
+                    }
+                }
+            }
+            std::vector<Position> visited;
+            sheet.ForEachInRange(top_left, bottom_right, [&visited](Position pos, const CellInterface&) {
+                visited.push_back(pos);
+            });
+            ASSERT_EQUAL(visited, expected);
+        }
+    }
+}
+
+void TestPrintableSizeAfterClear() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("B2"_pos, "a");
+    sheet->SetCell("C10"_pos, "b");
+    sheet->SetCell("Z3"_pos, "c");
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{10, 26}));
+
+    sheet->ClearCell("C10"_pos);
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{3, 26}));
+    sheet->ClearCell("Z3"_pos);
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{2, 2}));
+    sheet->SetCell(Position{Position::MAX_ROWS - 1, Position::MAX_COLS - 1}, "far");
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{Position::MAX_ROWS, Position::MAX_COLS}));
+    sheet->ClearCell(Position{Position::MAX_ROWS - 1, Position::MAX_COLS - 1});
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{2, 2}));
+    sheet->ClearCell("B2"_pos);
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{0, 0}));
+}
+
+void TestPrintableSizeAfterRejectedSet() {
+    auto sheet = CreateSheet();
+    try {
+        sheet->SetCell("E5"_pos, "=1+");
+        ASSERT(false);
+    } catch (const FormulaException&) {
+    }
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{0, 0}));
+    ASSERT(sheet->GetCell("E5"_pos) == nullptr);
+
+    sheet->SetCell("A1"_pos, "=E5");
+    try {
+        sheet->SetCell("E5"_pos, "=A1");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+    ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{1, 1}));
+    // the formula still reads the position as empty
+    sheet->SetCell("E5"_pos, "2");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("A1"_pos)->GetValue()), 2.0);
+}
+
+void TestOwnArena() {
+    for (auto kind : {CellStorageKind::Tiled, CellStorageKind::Hashed}) {
+        auto sheet = CreateSheet(SheetOptions{kind, /* own_arena = */ true});
+        for (int row = 0; row < 100; ++row) {
+            sheet->SetCell({row, 0}, std::to_string(row));
+            sheet->SetCell({row, 1}, "=A" + std::to_string(row + 1) + "*2");
+            sheet->SetCell({row, 2}, "some longer text that does not fit into SSO");
+        }
+        for (int row = 0; row < 100; row += 2) {
+            sheet->ClearCell({row, 2});
+            sheet->SetCell({row, 0}, "1");
+        }
+        for (int row = 0; row < 100; ++row) {
+            ASSERT_EQUAL(sheet->GetCell({row, 1})->GetValue(),
+                         CellInterface::Value(row % 2 ? row * 2.0 : 2.0));
+        }
+        ASSERT_EQUAL(sheet->GetCell("B3"_pos)->GetText(), "=A3*2");
+        ASSERT_EQUAL(sheet->GetPrintableSize(), (Size{100, 3}));
+    }
+}
+
+void TestCellContentKinds() {
+    auto sheet = CreateSheet();
+    const std::string inline_text(Cell::INLINE_TEXT_CAPACITY, 'x');
+    const std::string heap_text(Cell::INLINE_TEXT_CAPACITY + 1, 'y');
+
+    // switch one cell through every kind of content and back
+    const std::vector<std::string> texts{inline_text, heap_text, "=1+2", "'" + heap_text, "",
+                                         inline_text};
+    for (const std::string& text : texts) {
+        sheet->SetCell("A1"_pos, text);
+        ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), text);
+    }
+    sheet->SetCell("A1"_pos, "'" + heap_text);
+    ASSERT_EQUAL(std::get<std::string>(sheet->GetCell("A1"_pos)->GetValue()), heap_text);
+    sheet->SetCell("A1"_pos, "=1+2");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("A1"_pos)->GetValue()), 3.0);
+    sheet->SetCell("A1"_pos, "");
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("A1"_pos)->GetValue()), 0.0);
+}
+
+void TestValueView() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "'=escaped");
+    sheet->SetCell("A2"_pos, "12");
+    sheet->SetCell("A3"_pos, "=A2*2");
+    sheet->SetCell("A4"_pos, "=A1");
+
+    using View = CellInterface::ValueView;
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetValueView(), View(std::string_view("=escaped")));
+    ASSERT_EQUAL(sheet->GetCell("A2"_pos)->GetValueView(), View(std::string_view("12")));
+    ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetValueView(), View(24.0));
+    ASSERT_EQUAL(sheet->GetCell("A4"_pos)->GetValueView(),
+                 View(FormulaError(FormulaError::Category::Value)));
+
+    sheet->SetCell("A2"_pos, "99999999999999999999");
+    ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetValueView(), View(2e20));
+}
+
+void TestNumericCells() {
+    auto sheet = CreateSheet();
+    sheet->SetCell("A1"_pos, "007");
+    sheet->SetCell("A2"_pos, "123456789012345");
+    sheet->SetCell("A3"_pos, "1234567890123456");
+    sheet->SetCell("B1"_pos, "=A1+A2");
+    sheet->SetCell("B2"_pos, "=A3");
+
+    // numerals keep their exact text and stay text values
+    ASSERT_EQUAL(sheet->GetCell("A1"_pos)->GetText(), "007");
+    ASSERT_EQUAL(std::get<std::string>(sheet->GetCell("A1"_pos)->GetValue()), "007");
+    ASSERT_EQUAL(sheet->GetCell("A3"_pos)->GetText(), "1234567890123456");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("B1"_pos)->GetValue()), 123456789012352.0);
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("B2"_pos)->GetValue()), 1234567890123456.0);
+
+    sheet->SetCell("A1"_pos, "7a");
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+    sheet->SetCell("A1"_pos, "8");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("B1"_pos)->GetValue()), 123456789012353.0);
+
+    // digits beyond the range of a double
+    sheet->SetCell("A1"_pos, std::string(400, '9'));
+    ASSERT_EQUAL(sheet->GetCell("B1"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+
+    // formulas read escaped text without the escape sign, an empty value is 0
+    sheet->SetCell("C1"_pos, "'123");
+    sheet->SetCell("C2"_pos, "'");
+    sheet->SetCell("D1"_pos, "=C1+1");
+    sheet->SetCell("D2"_pos, "=C2+1");
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("D1"_pos)->GetValue()), 124.0);
+    ASSERT_EQUAL(std::get<double>(sheet->GetCell("D2"_pos)->GetValue()), 1.0);
+}
+
+void TestTextInterning() {
+    Sheet sheet;
+    const std::string label = "a label long enough to be shared between cells";
+    for (int row = 0; row < 3; ++row) {
+        sheet.SetCell({row, 0}, label);
+    }
+    sheet.SetCell("B1"_pos, "'" + label);
+
+    TextPool::Stats stats = sheet.GetMemoryStats().text_pool;
+    ASSERT_EQUAL(stats.unique_texts, 2u);
+    ASSERT_EQUAL(stats.references, 4u);
+    ASSERT_EQUAL(stats.unique_bytes, 2 * label.size() + 1);
+    ASSERT_EQUAL(stats.referenced_bytes, 4 * label.size() + 1);
+
+    sheet.SetCell("A1"_pos, "short");
+    sheet.ClearCell("A2"_pos);
+    sheet.SetCell("A3"_pos, label);
+    ASSERT_EQUAL(sheet.GetCell("A3"_pos)->GetText(), label);
+    ASSERT_EQUAL(std::get<std::string>(sheet.GetCell("B1"_pos)->GetValue()), label);
+    stats = sheet.GetMemoryStats().text_pool;
+    ASSERT_EQUAL(stats.unique_texts, 2u);
+    ASSERT_EQUAL(stats.references, 2u);
+
+    sheet.ClearCell("A3"_pos);
+    sheet.SetCell("B1"_pos, "=1");
+    stats = sheet.GetMemoryStats().text_pool;
+    ASSERT_EQUAL(stats.unique_texts, 0u);
+    ASSERT_EQUAL(stats.unique_bytes, 0u);
+}
+
+void TestMemoryStats() {
+    for (auto kind : {CellStorageKind::Tiled, CellStorageKind::Hashed}) {
+        Sheet sheet(SheetOptions{kind});
+        const SheetMemoryStats empty = sheet.GetMemoryStats();
+        ASSERT_EQUAL(empty.cell_count, 0u);
+        ASSERT_EQUAL(empty.formulas, 0u);
+        ASSERT_EQUAL(empty.dependencies, 0u);
+
+        sheet.SetCell("A1"_pos, "=B1+C1");
+        sheet.SetCell("D1"_pos, "a label long enough to be kept in the text pool");
+        SheetMemoryStats stats = sheet.GetMemoryStats();
+        ASSERT_EQUAL(stats.cell_count, 2u);
+        ASSERT_EQUAL(stats.formula_cell_count, 1u);
+        ASSERT_EQUAL(stats.empty_cell_count, 0u);
+        ASSERT_EQUAL(stats.referenced_empty_positions, 2u);
+        ASSERT(stats.cell_storage >= 2 * sizeof(Cell));
+        ASSERT(stats.index > 0);
+        ASSERT(stats.texts > stats.text_pool.unique_bytes);
+        ASSERT(stats.formulas > 0);
+        ASSERT(stats.dependencies > 0);
+        // a double, an error byte and a version stamp inside the cell
+        ASSERT_EQUAL(stats.value_caches, sizeof(double) + sizeof(std::uint8_t) + sizeof(std::uint32_t));
+        ASSERT(stats.GetTotal() > empty.GetTotal());
+
+        sheet.ClearCell("A1"_pos);
+        sheet.ClearCell("D1"_pos);
+        stats = sheet.GetMemoryStats();
+        ASSERT_EQUAL(stats.formulas, 0u);
+        ASSERT_EQUAL(stats.text_pool.unique_bytes, 0u);
+        ASSERT_EQUAL(stats.cell_count, 0u);
+        ASSERT_EQUAL(stats.referenced_empty_positions, 0u);
+    }
+}
+
+void TestReferencedEmptyPositions() {
+    Sheet sheet;
+    sheet.SetCell("A1"_pos, "=B1+C1");
+    // referenced positions look like empty cells but hold none
+    ASSERT(sheet.GetCell("B1"_pos) != nullptr);
+    ASSERT_EQUAL(sheet.GetCell("B1"_pos)->GetText(), "");
+    ASSERT_EQUAL(sheet.GetMemoryStats().cell_count, 1u);
+    ASSERT_EQUAL(sheet.GetPrintableSize(), (Size{1, 1}));
+
+    sheet.SetCell("B1"_pos, "5");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("A1"_pos)->GetValue()), 5.0);
+    sheet.ClearCell("B1"_pos);
+    ASSERT(sheet.GetCell("B1"_pos) != nullptr);
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("A1"_pos)->GetValue()), 0.0);
+    sheet.SetCell("B1"_pos, "=C1*3+1");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("A1"_pos)->GetValue()), 1.0);
+    sheet.SetCell("C1"_pos, "2");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell("A1"_pos)->GetValue()), 9.0);
+
+    // the cycle goes through a cell created after the formula referring to it
+    try {
+        sheet.SetCell("C1"_pos, "=A1");
+        ASSERT(false);
+    } catch (const CircularDependencyException&) {
+    }
+
+    // nothing refers to D1 once the formula is replaced
+    sheet.SetCell("A2"_pos, "=D1");
+    sheet.SetCell("A2"_pos, "=1");
+    ASSERT(sheet.GetCell("D1"_pos) == nullptr);
+
+    // a cleared formula leaves no edges behind
+    sheet.ClearCell("B1"_pos);
+    sheet.ClearCell("A1"_pos);
+    sheet.SetCell("C1"_pos, "3");
+    ASSERT(sheet.GetCell("B1"_pos) == nullptr);
+    ASSERT_EQUAL(sheet.GetMemoryStats().referenced_empty_positions, 0u);
+}
+
+void TestLayeredInvalidation() {
+    // every cell sums the three cells of the row above: 3^29 paths from A1
+    // to the last row, an edit must not walk them all.
+    // Built from the bottom so that the cycle checks see no formulas.
+    constexpr int LAYERS = 30;
+    Sheet sheet;
+    for (int row = LAYERS - 1; row > 0; --row) {
+        for (int col = 0; col < 3; ++col) {
+            std::string formula = "=";
+            for (int prev = 0; prev < 3; ++prev) {
+                formula += (prev ? "+" : "") + Position{row - 1, prev}.ToString();
+            }
+            sheet.SetCell({row, col}, formula);
+        }
+    }
+    for (int col = 0; col < 3; ++col) {
+        sheet.SetCell({0, col}, "1");
+    }
+    const Position last{LAYERS - 1, 2};
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell(last)->GetValue()), std::pow(3.0, LAYERS - 1));
+    sheet.SetCell("A1"_pos, "2");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell(last)->GetValue()), 4 * std::pow(3.0, LAYERS - 2));
+}
+
+void TestLongChain() {
+    // cell k refers to cell k - 1, the chain snakes through the columns;
+    // a recursive evaluation of the last cell would overflow the stack
+    constexpr int LENGTH = 200'000;
+    auto at = [](int k) {
+        return Position{k % Position::MAX_ROWS, k / Position::MAX_ROWS};
+    };
+    Sheet sheet;
+    // from the end, so that the cycle checks see no formulas
+    for (int k = LENGTH - 1; k > 0; --k) {
+        sheet.SetCell(at(k), "=" + at(k - 1).ToString() + "+1");
+    }
+    sheet.SetCell(at(0), "1");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell(at(LENGTH - 1))->GetValue()), double(LENGTH));
+
+    sheet.SetCell(at(0), "=10");
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell(at(LENGTH - 1))->GetValue()), double(LENGTH + 9));
+    ASSERT_EQUAL(std::get<double>(sheet.GetCell(at(LENGTH / 2))->GetValue()), double(LENGTH / 2 + 10));
+}
+
+void TestRecalculate() {
+    Sheet sheet;
+    auto value = [&sheet](std::string_view pos) {
+        return std::get<double>(sheet.GetCell(Position::FromString(pos))->GetValue());
+    };
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1+1");
+    sheet.SetCell("C1"_pos, "=B1*2");
+    RecalcStats stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 2u);
+    ASSERT(!stats.plan_rebuilt);
+    ASSERT_EQUAL(value("C1"), 4.0);
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, 0u);
+
+    sheet.SetCell("A1"_pos, "5");
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, 2u);
+    ASSERT_EQUAL(value("C1"), 12.0);
+
+    // the new references are in front, the formula keeps its place
+    sheet.SetCell("B1"_pos, "=A1+2");
+    stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 2u);
+    ASSERT(!stats.plan_rebuilt);
+    ASSERT_EQUAL(value("C1"), 14.0);
+
+    // a referenced cell becomes a formula, the order is rebuilt
+    sheet.SetCell("A1"_pos, "=3");
+    stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 3u);
+    ASSERT(stats.plan_rebuilt);
+    ASSERT_EQUAL(value("C1"), 10.0);
+
+    // a formula moved behind the cell it now refers to
+    sheet.SetCell("D1"_pos, "=7");
+    sheet.SetCell("A1"_pos, "=D1");
+    stats = sheet.Recalculate();
+    ASSERT(stats.plan_rebuilt);
+    ASSERT_EQUAL(stats.evaluated, 4u);
+    ASSERT_EQUAL(value("C1"), 18.0);
+
+    // cleared and erased formulas leave the order
+    sheet.SetCell("B1"_pos, "");
+    sheet.ClearCell("D1"_pos);
+    stats = sheet.Recalculate();
+    ASSERT(!stats.plan_rebuilt);
+    ASSERT_EQUAL(stats.evaluated, 2u);
+    ASSERT_EQUAL(value("A1"), 0.0);
+    ASSERT_EQUAL(value("C1"), 0.0);
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, 0u);
+}
+
+void TestParallelRecalculate() {
+    // an input row under three layers of 1000 formulas, some of them errors
+    constexpr int WIDTH = 1000;
+    auto fill = [](Sheet& sheet, int input) {
+        for (int col = 0; col < WIDTH; ++col) {
+            sheet.SetCell({0, col}, col % 97 == 0 ? "text" : std::to_string(input + col % 7));
+        }
+    };
+    auto build = [&fill](Sheet& sheet) {
+        fill(sheet, 0);
+        for (int row = 1; row <= 3; ++row) {
+            for (int col = 0; col < WIDTH; ++col) {
+                const std::string above = Position{row - 1, col}.ToString();
+                const std::string left = Position{row - 1, (col + WIDTH - 1) % WIDTH}.ToString();
+                sheet.SetCell({row, col}, "=" + above + "/" + left + "+" + above);
+            }
+        }
+    };
+    Sheet serial;
+    Sheet parallel(SheetOptions{CellStorageKind::Tiled, false, 4});
+    build(serial);
+    build(parallel);
+    for (int input : {0, 5}) {
+        fill(serial, input);
+        fill(parallel, input);
+        ASSERT_EQUAL(serial.Recalculate().evaluated, size_t{3 * WIDTH});
+        const RecalcStats stats = parallel.Recalculate();
+        ASSERT_EQUAL(stats.evaluated, size_t{3 * WIDTH});
+        ASSERT_EQUAL(stats.levels, 3u);
+        for (int row = 1; row <= 3; ++row) {
+            for (int col = 0; col < WIDTH; ++col) {
+                ASSERT_EQUAL(parallel.GetCell({row, col})->GetValue(),
+                             serial.GetCell({row, col})->GetValue());
+            }
+        }
+    }
+}
+
+void TestEarlyCutoff() {
+    SheetOptions options;
+    options.early_cutoff = true;
+    Sheet sheet(options);
+    auto value = [&sheet](std::string_view pos) {
+        return sheet.GetCell(Position::FromString(pos))->GetValue();
+    };
+    sheet.SetCell("A1"_pos, "5");
+    sheet.SetCell("B1"_pos, "=A1*0");
+    sheet.SetCell("C1"_pos, "=B1+1");
+    sheet.SetCell("D1"_pos, "=C1*2+A1");
+    RecalcStats stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 3u);
+    ASSERT_EQUAL(stats.skipped, 0u);
+
+    // B1 keeps its value, C1 is not evaluated, D1 refers to A1 as well
+    sheet.SetCell("A1"_pos, "7");
+    stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 2u);
+    ASSERT_EQUAL(stats.skipped, 1u);
+    ASSERT_EQUAL(value("C1"), CellInterface::Value(1.0));
+    ASSERT_EQUAL(value("D1"), CellInterface::Value(9.0));
+
+    // an error is a change as well
+    sheet.SetCell("A1"_pos, "text");
+    stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 3u);
+    ASSERT_EQUAL(value("D1"), CellInterface::Value(FormulaError(FormulaError::Category::Value)));
+
+    // reads before Recalculate cut off the same way
+    sheet.SetCell("A1"_pos, "1");
+    ASSERT_EQUAL(value("D1"), CellInterface::Value(3.0));
+    sheet.SetCell("A1"_pos, "2");
+    ASSERT_EQUAL(value("C1"), CellInterface::Value(1.0));
+    ASSERT_EQUAL(value("D1"), CellInterface::Value(4.0));
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, 0u);
+
+    // an edited cell and its direct dependents are evaluated, the cutoff
+    // starts behind them
+    sheet.SetCell("B1"_pos, "=A1-A1");
+    stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 2u);
+    ASSERT_EQUAL(stats.skipped, 1u);
+    ASSERT_EQUAL(value("D1"), CellInterface::Value(4.0));
+
+    // a change from 0 to -0 is a change, it is printed
+    Sheet signs(options);
+    signs.SetCell("A1"_pos, "0");
+    signs.SetCell("C1"_pos, "1");
+    signs.SetCell("B1"_pos, "=A1*C1");
+    signs.SetCell("D1"_pos, "=B1");
+    ASSERT(!std::signbit(std::get<double>(signs.GetCell("D1"_pos)->GetValue())));
+    signs.SetCell("C1"_pos, "=0-1");
+    ASSERT(std::signbit(std::get<double>(signs.GetCell("B1"_pos)->GetValue())));
+    ASSERT(std::signbit(std::get<double>(signs.GetCell("D1"_pos)->GetValue())));
+
+    // the parallel pass skips the same formulas
+    constexpr int WIDTH = 1000;
+    options.recalc_threads = 4;
+    Sheet parallel(options);
+    parallel.SetCell("A1"_pos, "1");
+    for (int col = 0; col < WIDTH; ++col) {
+        // half of the first layer does not depend on the value of A1
+        parallel.SetCell({1, col}, col % 2 == 0 ? "=A1*0" : "=A1+" + std::to_string(col));
+        parallel.SetCell({2, col}, "=" + Position{1, col}.ToString() + "*2");
+    }
+    parallel.Recalculate();
+    parallel.SetCell("A1"_pos, "2");
+    stats = parallel.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, size_t{WIDTH + WIDTH / 2});
+    ASSERT_EQUAL(stats.skipped, size_t{WIDTH / 2});
+    ASSERT_EQUAL(parallel.GetCell({2, 0})->GetValue(), CellInterface::Value(0.0));
+    ASSERT_EQUAL(parallel.GetCell({2, 1})->GetValue(), CellInterface::Value(6.0));
+}
+
+void TestVersionStamps() {
+    SheetOptions options;
+    options.validation = CacheValidation::VersionStamps;
+    Sheet versioned(options);
+    Sheet pushed;
+    options.recalc_threads = 4;
+    Sheet versioned_parallel(options);
+    Sheet* sheets[] = {&versioned, &pushed, &versioned_parallel};
+
+    // random edits of a 6x6 area, the values must agree after each one
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> coord(0, 5);
+    std::uniform_int_distribution<int> action(0, 9);
+    auto random_pos = [&] {
+        return Position{coord(gen), coord(gen)};
+    };
+    for (int step = 0; step < 3000; ++step) {
+        const Position pos = random_pos();
+        std::string text;
+        const int what = action(gen);
+        if (what < 3) {
+            text = std::to_string(coord(gen));
+        } else if (what < 8) {
+            text = "=" + std::string(random_pos().ToString()) + "+" + std::string(random_pos().ToString())
+                   + "/" + std::to_string(coord(gen));
+        } else if (what == 8) {
+            text = "text";
+        }
+        for (Sheet* sheet : sheets) {
+            try {
+                if (text.empty()) {
+                    sheet->ClearCell(pos);
+                } else {
+                    sheet->SetCell(pos, text);
+                }
+            } catch (const CircularDependencyException&) {
+            }
+        }
+        if (step % 3 == 0) {
+            versioned_parallel.Recalculate();
+        }
+        for (int row = 0; row < 6; ++row) {
+            for (int col = 0; col < 6; ++col) {
+                const CellInterface* expected = pushed.GetCell({row, col});
+                for (Sheet* sheet : {&versioned, &versioned_parallel}) {
+                    const CellInterface* cell = sheet->GetCell({row, col});
+                    ASSERT_EQUAL(cell == nullptr, expected == nullptr);
+                    if (cell != nullptr) {
+                        ASSERT_EQUAL(cell->GetValue(), expected->GetValue());
+                    }
+                }
+            }
+        }
+    }
+
+    // a write touches nothing but the cell, unchanged inputs skip evaluation
+    Sheet sheet(SheetOptions{CellStorageKind::Tiled, false, 1, false, CacheValidation::VersionStamps});
+    sheet.SetCell("A1"_pos, "1");
+    sheet.SetCell("B1"_pos, "=A1*0");
+    sheet.SetCell("C1"_pos, "=B1+1");
+    sheet.SetCell("D1"_pos, "=5");
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, 3u);
+    sheet.SetCell("A1"_pos, "2");
+    const RecalcStats stats = sheet.Recalculate();
+    ASSERT_EQUAL(stats.evaluated, 1u);
+    ASSERT_EQUAL(stats.skipped, 2u);
+    ASSERT_EQUAL(sheet.GetCell("C1"_pos)->GetValue(), CellInterface::Value(1.0));
+
+    // a change from 0 to -0 bumps the stamp, it is printed
+    Sheet signs(SheetOptions{CellStorageKind::Tiled, false, 1, false, CacheValidation::VersionStamps});
+    signs.SetCell("A1"_pos, "0");
+    signs.SetCell("C1"_pos, "1");
+    signs.SetCell("B1"_pos, "=A1*C1");
+    signs.SetCell("D1"_pos, "=B1");
+    ASSERT(!std::signbit(std::get<double>(signs.GetCell("D1"_pos)->GetValue())));
+    signs.SetCell("C1"_pos, "=0-1");
+    ASSERT(std::signbit(std::get<double>(signs.GetCell("B1"_pos)->GetValue())));
+    ASSERT(std::signbit(std::get<double>(signs.GetCell("D1"_pos)->GetValue())));
+}
+
+void TestDependencyGraphChurn() {
+    // formulas in column B keep being pointed at other inputs of column A,
+    // cleared and recreated; enough edits to compact the graph many times
+    constexpr int INPUTS = 20;
+    constexpr int FORMULAS = 100;
+    Sheet sheet;
+    std::vector<int> input_value(INPUTS);
+    std::vector<int> formula_ref(FORMULAS, -1);  // -1 if there is no formula
+    for (int i = 0; i < INPUTS; ++i) {
+        input_value[i] = i;
+        sheet.SetCell({i, 0}, std::to_string(i));
+    }
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<int> input(0, INPUTS - 1);
+    std::uniform_int_distribution<int> formula(0, FORMULAS - 1);
+    for (int step = 0; step < 20'000; ++step) {
+        const int f = formula(gen);
+        switch (step % 4) {
+            case 0:
+            case 1:
+                formula_ref[f] = input(gen);
+                sheet.SetCell({f, 1}, "=" + std::string(Position{formula_ref[f], 0}.ToString()) + "*2");
+                break;
+            case 2:
+                formula_ref[f] = -1;
+                sheet.ClearCell({f, 1});
+                break;
+            case 3: {
+                const int i = input(gen);
+                input_value[i] = step;
+                sheet.SetCell({i, 0}, std::to_string(step));
+                break;
+            }
+        }
+        if (step % 100 == 0) {
+            for (int k = 0; k < FORMULAS; ++k) {
+                if (formula_ref[k] >= 0) {
+                    ASSERT_EQUAL(sheet.GetCell({k, 1})->GetValue(),
+                                 CellInterface::Value(2.0 * input_value[formula_ref[k]]));
+                }
+            }
+        }
+    }
+}
+
+void TestReplacedFormulaEdges() {
+    Sheet sheet;
+    sheet.SetCell("B1"_pos, "1");
+    sheet.SetCell("C1"_pos, "2");
+    sheet.SetCell("A1"_pos, "=B1+C1+D1");
+    // C1 is kept, B1 and the pending D1 are dropped, E1 and F1 are new
+    sheet.SetCell("A1"_pos, "=C1+E1+F1");
+    sheet.SetCell("E1"_pos, "3");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(5.0));
+    sheet.Recalculate();
+
+    sheet.SetCell("B1"_pos, "10");
+    sheet.SetCell("D1"_pos, "10");
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, size_t{0});
+    ASSERT_EQUAL(sheet.GetMemoryStats().referenced_empty_positions, size_t{1});
+    sheet.SetCell("C1"_pos, "20");
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, size_t{1});
+    sheet.SetCell("F1"_pos, "30");
+    ASSERT_EQUAL(sheet.Recalculate().evaluated, size_t{1});
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(53.0));
+
+    // the same references in another formula
+    sheet.SetCell("A1"_pos, "=F1-E1-C1");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(7.0));
+    sheet.SetCell("E1"_pos, "4");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(6.0));
+}
+
+void TestRandomCycles() {
+    // random formulas on a 6x6 sheet, cycles are found by a walk of the
+    // references kept alongside
+    constexpr int SIDE = 6;
+    Sheet sheet;
+    std::map<Position, std::vector<Position>> refs;
+    const auto reaches = [&refs](Position from, Position to) {
+        std::vector<Position> stack{from};
+        std::set<Position> visited;
+        while (!stack.empty()) {
+            const Position pos = stack.back();
+            stack.pop_back();
+            if (pos == to) {
+                return true;
+            }
+            if (visited.insert(pos).second && refs.count(pos)) {
+                stack.insert(stack.end(), refs[pos].begin(), refs[pos].end());
+            }
+        }
+        return false;
+    };
+    std::mt19937 gen(13);
+    std::uniform_int_distribution<int> coord(0, SIDE - 1);
+    std::uniform_int_distribution<int> ref_count(1, 3);
+    for (int step = 0; step < 20'000; ++step) {
+        const Position pos{coord(gen), coord(gen)};
+        if (step % 5 == 0) {
+            refs.erase(pos);
+            sheet.ClearCell(pos);
+            continue;
+        }
+        std::vector<Position> new_refs;
+        std::string text = "=1";
+        for (int k = ref_count(gen); k > 0; --k) {
+            new_refs.push_back({coord(gen), coord(gen)});
+            text += "+" + new_refs.back().ToString();
+        }
+        bool cycle = false;
+        for (const Position ref : new_refs) {
+            cycle = cycle || reaches(ref, pos);
+        }
+        const std::string old_text = sheet.GetCell(pos) ? sheet.GetCell(pos)->GetText() : "";
+        bool caught = false;
+        try {
+            sheet.SetCell(pos, text);
+            refs[pos] = new_refs;
+        } catch (const CircularDependencyException&) {
+            caught = true;
+        }
+        ASSERT_EQUAL(caught, cycle);
+        if (caught) {
+            ASSERT_EQUAL(sheet.GetCell(pos) ? sheet.GetCell(pos)->GetText() : "", old_text);
+        }
+    }
+}
+
+void TestBoundReferences() {
+    Sheet sheet;
+    sheet.SetCell("B1"_pos, "1");
+    sheet.SetCell("A1"_pos, "=B1+C1*B1");
+    // created, cleared and erased under a formula bound to them
+    sheet.SetCell("C1"_pos, "2");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(3.0));
+    sheet.ClearCell("B1"_pos);
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(0.0));
+    sheet.SetCell("B1"_pos, "=C1+1");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(9.0));
+    sheet.SetCell("C1"_pos, "");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(), CellInterface::Value(1.0));
+    sheet.ClearCell("C1"_pos);
+    sheet.SetCell("C1"_pos, "text");
+    ASSERT_EQUAL(sheet.GetCell("A1"_pos)->GetValue(),
+                 CellInterface::Value(FormulaError::Category::Value));
+
+    // a formula parsed alone reads the sheet until it is bound
+    auto formula = ParseFormula("B1*2");
+    ASSERT(formula->Evaluate(sheet) == FormulaInterface::Value(FormulaError::Category::Value));
+    formula->BindCell("B1"_pos, nullptr);
+    ASSERT(formula->Evaluate(sheet) == FormulaInterface::Value(0.0));
+}
+
 void TestCellReferences() {
     auto sheet = CreateSheet();
     sheet->SetCell("A1"_pos, "1");
@@ -363,9 +1310,34 @@ int main() {
     RUN_TEST(tr, TestFormulaReferencedCells);
     RUN_TEST(tr, TestErrorValue);
     RUN_TEST(tr, TestErrorArithmetic);
+    RUN_TEST(tr, TestDeepExpressions);
+    RUN_TEST(tr, TestConstantFolding);
+    RUN_TEST(tr, TestFormulaBlock);
     RUN_TEST(tr, TestEmptyCellTreatedAsZero);
     RUN_TEST(tr, TestFormulaInvalidPosition);
     RUN_TEST(tr, TestPrint);
+    RUN_TEST(tr, TestPrintAcrossTiles);
+    RUN_TEST(tr, TestStorageRandomOperations);
+    RUN_TEST(tr, TestForEachInRange);
+    RUN_TEST(tr, TestPrintableSizeAfterClear);
+    RUN_TEST(tr, TestPrintableSizeAfterRejectedSet);
+    RUN_TEST(tr, TestOwnArena);
+    RUN_TEST(tr, TestCellContentKinds);
+    RUN_TEST(tr, TestValueView);
+    RUN_TEST(tr, TestNumericCells);
+    RUN_TEST(tr, TestTextInterning);
+    RUN_TEST(tr, TestMemoryStats);
+    RUN_TEST(tr, TestReferencedEmptyPositions);
+    RUN_TEST(tr, TestLayeredInvalidation);
+    RUN_TEST(tr, TestLongChain);
+    RUN_TEST(tr, TestRecalculate);
+    RUN_TEST(tr, TestParallelRecalculate);
+    RUN_TEST(tr, TestEarlyCutoff);
+    RUN_TEST(tr, TestVersionStamps);
+    RUN_TEST(tr, TestDependencyGraphChurn);
+    RUN_TEST(tr, TestReplacedFormulaEdges);
+    RUN_TEST(tr, TestRandomCycles);
+    RUN_TEST(tr, TestBoundReferences);
     RUN_TEST(tr, TestCellReferences);
     RUN_TEST(tr, TestFormulaIncorrect);
     RUN_TEST(tr, TestCellCircularReferences);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Deleter for objects created by NewObject: destroys the object and returns
+// its block to the memory resource it came from. Converts from the deleter of
+// a derived class, so PoolPtr<Derived> moves into PoolPtr<Base>.
+template <typename T>
+class PoolDeleter {
+public:
+    PoolDeleter() = default;
+    PoolDeleter(std::pmr::memory_resource* resource, std::size_t size, std::size_t align)
+        : resource_(resource)
+        , size_(static_cast<std::uint32_t>(size))
+        , align_(static_cast<std::uint32_t>(align)) {
+    }
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+    PoolDeleter(const PoolDeleter<U>& other)
+        : resource_(other.resource_)
+        , size_(other.size_)
+        , align_(other.align_) {
+    }
+
+    void operator()(T* ptr) const {
+        void* block = ptr;
+        if constexpr (std::is_polymorphic_v<T>) {
+            block = dynamic_cast<void*>(ptr);  // address of the most derived object
+        }
+        ptr->~T();
+        resource_->deallocate(block, size_, align_);
+    }
+
+private:
+    template <typename U>
+    friend class PoolDeleter;
+
+    std::pmr::memory_resource* resource_ = nullptr;
+    std::uint32_t size_ = 0;
+    std::uint32_t align_ = 0;
+};
+
+template <typename T>
+using PoolPtr = std::unique_ptr<T, PoolDeleter<T>>;
+
+// Allocates and constructs T from the memory resource. Without arguments the
+// object is default-initialized, so large trivial buffers are not zeroed.
+template <typename T, typename... Args>
+PoolPtr<T> NewObject(std::pmr::memory_resource* resource, Args&&... args) {
+    void* block = resource->allocate(sizeof(T), alignof(T));
+    T* ptr;
+    try {
+        if constexpr (sizeof...(Args) == 0) {
+            ptr = new (block) T;
+        } else {
+            ptr = new (block) T(std::forward<Args>(args)...);
+        }
+    } catch (...) {
+        resource->deallocate(block, sizeof(T), alignof(T));
+        throw;
+    }
+    return PoolPtr<T>(ptr, PoolDeleter<T>(resource, sizeof(T), alignof(T)));
+}
+
+// Forwards to the upstream resource and counts the bytes in use, so the
+// memory of a component can be reported without walking its structures.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream) {
+    }
+
+    std::size_t GetBytesInUse() const {
+        return bytes_in_use_;
+    }
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void* ptr = upstream_->allocate(bytes, alignment);
+        bytes_in_use_ += bytes;
+        return ptr;
+    }
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+        upstream_->deallocate(ptr, bytes, alignment);
+        bytes_in_use_ -= bytes;
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream_;
+    std::size_t bytes_in_use_ = 0;
+};
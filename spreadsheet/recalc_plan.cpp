@@ -0,0 +1,190 @@
+#include "recalc_plan.h"
+
+#include "cell.h"
+#include "cell_storage.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+
+void RecalcPlan::Append(Cell* cell) {
+    cell->plan_slot_ = static_cast<std::uint32_t>(order_.size());
+    order_.push_back(cell);
+}
+
+void RecalcPlan::OnFormulaSet(Cell* cell, bool was_formula) {
+    if (stale_) {
+        return;
+    }
+    if (was_formula) {
+        // the old place still precedes the dependents
+        const std::uint32_t slot = cell->plan_slot_;
+        bool refs_in_front = true;
+        cell->ForEachReferencedCell([slot, &refs_in_front](const Cell* ref) {
+            refs_in_front &= !ref->IsFormula() || ref->plan_slot_ < slot;
+        });
+        if (refs_in_front) {
+            order_[slot] = cell;
+            --hole_count_;
+            return;
+        }
+    } else if (!cell->HasDependents()) {
+        // every formula it refers to is already in the order
+        Append(cell);
+        return;
+    }
+    stale_ = true;
+}
+
+void RecalcPlan::OnFormulaRemoved(const Cell* cell) {
+    if (stale_) {
+        return;
+    }
+    assert(order_[cell->plan_slot_] == cell && "RecalcPlan err: formula out of the order");
+    order_[cell->plan_slot_] = nullptr;
+    ++hole_count_;
+}
+
+void RecalcPlan::Compact() {
+    order_.erase(std::remove(order_.begin(), order_.end(), nullptr), order_.end());
+    for (size_t i = 0; i < order_.size(); ++i) {
+        const_cast<Cell*>(order_[i])->plan_slot_ = static_cast<std::uint32_t>(i);
+    }
+    hole_count_ = 0;
+}
+
+void RecalcPlan::Rebuild(const CellStorage& cells) {
+    // Post-order DFS over the references, started from the formulas in
+    // row-major order. A formula is placed right after its operands, so the
+    // order follows the layout of the cells wherever the dependencies allow.
+    // plan_slot_ marks the formulas not yet placed while the order is built.
+    order_.clear();
+    cells.ForEach([](Position, const Cell& cell) {
+        if (cell.IsFormula()) {
+            const_cast<Cell&>(cell).plan_slot_ = UNVISITED;
+        }
+    });
+    cells.ForEach([this](Position, const Cell& cell) {
+        if (!cell.IsFormula() || cell.plan_slot_ != UNVISITED) {
+            return;
+        }
+        stack_.emplace_back(&cell, false);
+        while (!stack_.empty()) {
+            const auto [current, expanded] = stack_.back();
+            stack_.pop_back();
+            Cell* mutable_cell = const_cast<Cell*>(current);
+            if (expanded) {
+                mutable_cell->plan_slot_ = static_cast<std::uint32_t>(order_.size());
+                order_.push_back(current);
+                continue;
+            }
+            if (current->plan_slot_ != UNVISITED) {
+                continue;  // reached by another path
+            }
+            mutable_cell->plan_slot_ = VISITING;
+            stack_.emplace_back(current, true);
+            current->ForEachReferencedCell([this](const Cell* ref) {
+                if (ref->IsFormula() && ref->plan_slot_ == UNVISITED) {
+                    stack_.emplace_back(ref, false);
+                }
+            });
+        }
+    });
+    hole_count_ = 0;
+    stale_ = false;
+}
+
+RecalcStats RecalcPlan::Recalculate(const CellStorage& cells, WorkStealingPool* pool) {
+    RecalcStats stats;
+    if (stale_) {
+        Rebuild(cells);
+        stats.plan_rebuilt = true;
+    } else if (hole_count_ * 2 > order_.size()) {
+        Compact();
+    }
+    if (pool != nullptr && pool->GetThreadCount() > 1) {
+        EvaluateByLevels(*pool, stats);
+        return stats;
+    }
+    for (const Cell* cell : order_) {
+        if (cell != nullptr && !cell->HasValidCache()) {
+            ++(cell->Refresh() == Cell::RefreshResult::Skipped ? stats.skipped : stats.evaluated);
+        }
+    }
+    return stats;
+}
+
+void RecalcPlan::EvaluateByLevels(WorkStealingPool& pool, RecalcStats& stats) {
+    // The level of a dirty formula is one more than the highest level of its
+    // dirty operands. Formulas of one level do not refer to each other, so
+    // they are evaluated in parallel once the lower levels are done; every
+    // formula sees the same operand values as in the serial pass.
+    level_of_slot_.resize(order_.size());
+    level_sizes_.clear();
+    for (size_t slot = 0; slot < order_.size(); ++slot) {
+        const Cell* cell = order_[slot];
+        if (cell == nullptr || cell->HasValidCache()) {
+            continue;
+        }
+        std::uint32_t level = 0;
+        cell->ForEachReferencedCell([this, &level](const Cell* ref) {
+            if (ref->IsFormula() && !ref->HasValidCache()) {
+                level = std::max(level, level_of_slot_[ref->plan_slot_] + 1);
+            }
+        });
+        level_of_slot_[slot] = level;
+        if (level == level_sizes_.size()) {
+            level_sizes_.push_back(0);
+        }
+        ++level_sizes_[level];
+    }
+
+    // counting sort of the dirty formulas by level
+    std::vector<size_t> level_begin(level_sizes_.size() + 1, 0);
+    for (size_t level = 0; level < level_sizes_.size(); ++level) {
+        level_begin[level + 1] = level_begin[level] + level_sizes_[level];
+    }
+    batch_.resize(level_begin.back());
+    std::vector<size_t> next = level_begin;
+    for (size_t slot = 0; slot < order_.size(); ++slot) {
+        const Cell* cell = order_[slot];
+        if (cell != nullptr && !cell->HasValidCache()) {
+            batch_[next[level_of_slot_[slot]]++] = cell;
+        }
+    }
+
+    // Early cutoff decides per formula whether to evaluate it; the workers
+    // record the outcome and the dependents are marked between the levels,
+    // so no cell is written by two threads.
+    using Result = Cell::RefreshResult;
+    results_.resize(batch_.size());
+    const size_t threads = pool.GetThreadCount();
+    for (size_t level = 0; level < level_sizes_.size(); ++level) {
+        const Cell* const* first = batch_.data() + level_begin[level];
+        std::uint8_t* results = results_.data() + level_begin[level];
+        const size_t count = level_sizes_[level];
+        auto refresh = [first, results](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                results[i] = static_cast<std::uint8_t>(first[i]->Refresh(false));
+            }
+        };
+        if (count < PARALLEL_MIN_LEVEL_SIZE) {
+            refresh(0, count);
+        } else {
+            // several chunks per thread, so that stealing can even out the load
+            pool.ParallelFor(count, std::max<size_t>(count / (threads * 8), 64), refresh);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const auto result = static_cast<Result>(results[i]);
+            if (result == Result::Skipped) {
+                ++stats.skipped;
+                continue;
+            }
+            ++stats.evaluated;
+            if (result == Result::Changed && first[i]->context_.early_cutoff) {
+                first[i]->MarkDependentsForEvaluation();
+            }
+        }
+    }
+    stats.levels = level_sizes_.size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class Cell;
+class CellStorage;
+class WorkStealingPool;
+
+struct RecalcStats {
+    size_t evaluated = 0;       // formulas evaluated by the pass
+    bool plan_rebuilt = false;  // the order was rebuilt before the pass
+    size_t levels = 0;          // parallel pass: levels evaluated one after another
+    // early cutoff, version stamps: dirty formulas not evaluated as their
+    // operands kept their values
+    size_t skipped = 0;
+};
+
+// Formula cells of a sheet in topological order: a formula comes after every
+// formula it refers to, so one pass over the order evaluates the dirty cells
+// with their operands already cached.
+// Edits keep the order when they can: a new formula nobody refers to is
+// appended, a replaced formula keeps its place if its new references are all
+// in front of it, a removed formula leaves an empty slot. Any other edit marks
+// the order stale and the next Recalculate rebuilds it from the cells.
+class RecalcPlan {
+public:
+    RecalcPlan() = default;
+    RecalcPlan(const RecalcPlan&) = delete;
+    RecalcPlan& operator=(const RecalcPlan&) = delete;
+
+    // the cell got a formula and its edges, was_formula if it replaced one
+    void OnFormulaSet(Cell* cell, bool was_formula);
+    // the formula of the cell is about to be dropped
+    void OnFormulaRemoved(const Cell* cell);
+
+    // evaluates every formula without a cached value, in parallel by
+    // topological levels if a pool with several threads is given
+    RecalcStats Recalculate(const CellStorage& cells, WorkStealingPool* pool = nullptr);
+
+    bool IsStale() const {
+        return stale_;
+    }
+    // formulas in the order, the empty slots excluded
+    size_t GetSize() const {
+        return order_.size() - hole_count_;
+    }
+
+private:
+    void Rebuild(const CellStorage& cells);
+    // drops the empty slots
+    void Compact();
+    void Append(Cell* cell);
+    void EvaluateByLevels(WorkStealingPool& pool, RecalcStats& stats);
+
+    // plan_slot_ of the formulas while Rebuild runs
+    static constexpr std::uint32_t UNVISITED = ~std::uint32_t{0};
+    static constexpr std::uint32_t VISITING = UNVISITED - 1;
+    // smaller levels are evaluated by the calling thread alone
+    static constexpr size_t PARALLEL_MIN_LEVEL_SIZE = 256;
+
+    std::vector<const Cell*> order_;  // nullptr for a removed formula
+    size_t hole_count_ = 0;
+    bool stale_ = false;
+    // reused by Rebuild: cell, its references are pushed
+    std::vector<std::pair<const Cell*, bool>> stack_;
+    // reused by the parallel pass
+    std::vector<std::uint32_t> level_of_slot_;
+    std::vector<size_t> level_sizes_;
+    std::vector<const Cell*> batch_;  // dirty formulas grouped by level
+    std::vector<std::uint8_t> results_;  // Cell::RefreshResult of the formulas in batch_
+};
@@ -1,199 +1,212 @@
 #include "sheet.h"
 
 #include "cell.h"
+#include "cell_storage.h"
 #include "common.h"
+#include "thread_pool.h"
 
 #include <algorithm>
 #include <cassert>
 #include <vector>
 #include <functional>
 #include <iostream>
+#include <memory_resource>
 #include <optional>
 
 using namespace std::literals;
 
 struct Sheet::Impl {
-    Size size_{0, 0};
-    std::list<Cell> contents_;
-
-    // contain indices to access (get, erase, create new) cells by O(1)
-    // in format row_indices_ <x1: <y1: deque_idx1,...>, <x2: ...>>
-    // in format col_indices_ <y1: <x1: deque_idx1,...>, <y2: ...>>
-    using cell_iterator = std::list<Cell>::iterator;
-    using const_cell_iterator = std::list<Cell>::const_iterator;
-    using IndexTable = std::unordered_map<int,
-                        std::unordered_map<int, cell_iterator>>;
-    // using IndexTable = std::std::unordered_map<int, std::unordered_map<int, int>>;
-    IndexTable rows_indices_;
-    IndexTable cols_indices_;
-
-public:
-    // returns end iterator if there is no cell with the position
-    cell_iterator FindIterator(Position pos) {
-        auto row_it = rows_indices_.find(pos.row);
-        if (row_it == rows_indices_.end()) {
-            return EndContents();
-        }
-        auto cell_idx = row_it->second.find(pos.col);
-        if (cell_idx == row_it->second.end()) {
-            return EndContents();
-        }
-
-        return cell_idx->second;
-    }
-    const_cell_iterator FindIterator(Position pos) const {
-        return static_cast<const_cell_iterator>(FindIterator(pos));
-    }
-    
-    const_cell_iterator EndContents() const {
-        return contents_.end();
-    }
-    cell_iterator EndContents() {
-        return contents_.end();
-    }
+    Impl(Sheet& sheet, const SheetOptions& options)
+        : arena_(options.own_arena ? std::make_unique<std::pmr::unsynchronized_pool_resource>()
+                                   : nullptr)
+        , context_(sheet, GetResource())
+        , cells_(CreateCellStorage(options.storage, GetResource()))
+        , pool_(options.recalc_threads > 1 ? std::make_unique<WorkStealingPool>(options.recalc_threads)
+                                           : nullptr) {
+        context_.storage = cells_.get();
+        context_.validation = options.validation;
+        context_.early_cutoff = options.early_cutoff
+                                && options.validation == CacheValidation::PushInvalidation;
+    }
+
+    std::pmr::memory_resource* GetResource() {
+        return arena_ ? arena_.get() : std::pmr::get_default_resource();
+    }
+
+    // declared first: everything below is allocated from it
+    std::unique_ptr<std::pmr::unsynchronized_pool_resource> arena_;
+    // outlives the cells
+    CellContext context_;
+    std::unique_ptr<CellStorage> cells_;
+    std::unique_ptr<WorkStealingPool> pool_;  // parallel Recalculate only
 };
 
-Sheet::Sheet() : impl_(std::make_unique<Impl>()) {}
+Sheet::Sheet(SheetOptions options) : impl_(std::make_unique<Impl>(*this, options)) {}
 Sheet::~Sheet() {}
 
-void Sheet::CheckPushSize(Position pos) {
-    if(pos.row + 1 > impl_->size_.rows) {
-        impl_->size_.rows = pos.row + 1;
-    }
-    if(pos.col + 1 > impl_->size_.cols) {
-        impl_->size_.cols = pos.col + 1;
+void Sheet::CheckPosition(Position pos) {
+    if (!pos.IsValid()) {
+        throw InvalidPositionException("invalid position {" + std::to_string(pos.row) + ','
+                                       + std::to_string(pos.col) + '}');
     }
 }
 
 void Sheet::SetCell(Position pos, std::string text) {
-    if (!pos.IsValid()) {
-        throw InvalidPositionException("invalid position {" + pos.row + ',' + pos.col + '}');
-    }
-    if (auto it = impl_->FindIterator(pos); it != impl_->EndContents()) {
-        it->Set(text);
+    CheckPosition(pos);
+    if (Cell* cell = impl_->cells_->Find(pos)) {
+        cell->Set(std::move(text));
     } else {
-        impl_->contents_.emplace_back(*this);
-        it = std::prev(impl_->EndContents());
-        impl_->rows_indices_[pos.row][pos.col] = it;
-        impl_->cols_indices_[pos.col][pos.row] = it;
-        impl_->contents_.back().Set(text);
+        Cell& new_cell = impl_->cells_->Emplace(pos, impl_->context_);
+        new_cell.AdoptDependents(pos);
+        try {
+            new_cell.Set(std::move(text));
+        } catch (...) {
+            // a rejected formula leaves no cell to widen the printable area
+            new_cell.Detach(pos);
+            impl_->cells_->Erase(pos);
+            throw;
+        }
     }
-
-    CheckPushSize(pos);
 }
 
-const CellInterface* Sheet::GetCell(Position pos) const {
-    if (!pos.IsValid()) {
-        throw InvalidPositionException("invalid position {" + pos.row + ',' + pos.col + '}');
+namespace {
+// Stands for a position that formulas refer to but that holds no cell.
+class ReferencedEmptyCell final : public CellInterface {
+public:
+    Value GetValue() const override {
+        return double(0);
     }
-    const auto it = impl_->FindIterator(pos);
-    return it == impl_->EndContents() ? nullptr : &(*it);
-}   
-
-CellInterface* Sheet::GetCell(Position pos) {
-    return const_cast<CellInterface*>(const_cast<const Sheet*>(this)->GetCell(pos));
-}
-
-using IndexTable = std::unordered_map<int, std::unordered_map<int, std::list<Cell>::iterator>>;
-void RemoveFromIndexTable(int i, int j
-        , IndexTable& table) {
-    auto i_it = table.find(i);
-    assert(i_it != table.end() && "RemoveFromIndexTable err: wrong i idx");
-    if (i_it->second.size() == 1) {
-        // as example, if it is last element on row -> remove whole row from table;
-        table.erase(i_it);
-    } else {
-        auto j_it = i_it->second.find(j);
-        assert(j_it != i_it->second.end() && "RemoveFromIndexTable err: wrong j idx");
-        i_it->second.erase(j_it);
+    ValueView GetValueView() const override {
+        return double(0);
     }
-}
-
-// -1 if no next index
-int FindSameOrNextIndex(int idx, IndexTable& table, bool backward = false) {
-    if (backward) {
-        for (; table.find(idx) == table.end() && idx > 0; --idx) {}
-        return idx;
-    } else {
-        for (; table.find(idx) == table.end() && idx < 20000; ++idx) {}
-        return idx;
+    std::variant<double, FormulaError> GetNumericValue() const override {
+        return double(0);
     }
-}
-
-// after removal
-void Sheet::EraseSize(Position pos) {
-
-    Size& size_ref = impl_->size_;
-    if (size_ref == Size{1, 1}) {
-        size_ref = Size{0, 0};
-        return;
+    std::string GetText() const override {
+        return "";
     }
+    std::vector<Position> GetReferencedCells() const override {
+        return {};
+    }
+};
 
-    Position brp{size_ref.rows - 1, size_ref.cols - 1};
-    if (brp.row == pos.row) {
-        brp.row = FindSameOrNextIndex(pos.row, impl_->rows_indices_, true);
-        size_ref.rows -= pos.row - brp.row;
+ReferencedEmptyCell referenced_empty_cell;
+}  // namespace
+
+const CellInterface* Sheet::GetCell(Position pos) const {
+    CheckPosition(pos);
+    if (const Cell* cell = impl_->cells_->Find(pos)) {
+        return cell;
     }
-    if (brp.col == pos.col) {
-        brp.col = FindSameOrNextIndex(pos.col, impl_->cols_indices_, true);
-        size_ref.cols -= pos.col - brp.col;
+    if (impl_->context_.pending_dependents.count(PackPosition(pos)) > 0) {
+        return &referenced_empty_cell;
     }
+    return nullptr;
+}
+
+CellInterface* Sheet::GetCell(Position pos) {
+    return const_cast<CellInterface*>(const_cast<const Sheet*>(this)->GetCell(pos));
 }
 
 void Sheet::ClearCell(Position pos) {
-    if (!pos.IsValid()) {
-        throw InvalidPositionException("invalid position {" + pos.row + ',' + pos.col + '}');
-    }
-    auto it = impl_->FindIterator(pos);
-    if (it == impl_->EndContents()) {
-        return;
+    CheckPosition(pos);
+    if (Cell* cell = impl_->cells_->Find(pos)) {
+        cell->Detach(pos);
+        impl_->cells_->Erase(pos);
     }
-    impl_->contents_.erase(it);
-    RemoveFromIndexTable(pos.row, pos.col, impl_->rows_indices_);
-    RemoveFromIndexTable(pos.col, pos.row, impl_->cols_indices_);
-    EraseSize(pos);
 }
 
 Size Sheet::GetPrintableSize() const {
-    return impl_->size_;
+    return impl_->cells_->GetBoundingSize();
 }
 
-void PrintVal(std::ostream& output, CellInterface::Value val) {
+void PrintVal(std::ostream& output, CellInterface::ValueView val) {
     if (std::holds_alternative<double>(val)) {
         output << std::get<double>(val);
-    } else if (std::holds_alternative<std::string>(val)) {
-        output << std::get<std::string>(val);
+    } else if (std::holds_alternative<std::string_view>(val)) {
+        output << std::get<std::string_view>(val);
     } else if (std::holds_alternative<FormulaError>(val)) {
         output << std::get<FormulaError>(val);
     }
 }
-void Sheet::PrintValues(std::ostream& output) const {
-    for (int row = 0; row < impl_->size_.rows; ++row) {
-        for (int col = 0; col < impl_->size_.cols; ++col) {
-            if (col > 0) {
-                output << '\t';
-            }
-            if (auto it = impl_->FindIterator({row, col}); it != impl_->EndContents()) {
-                PrintVal(output, it->GetValue());
-            }
+// prints every row of the printable area, print_cell is called for the
+// occupied positions only
+template <typename PrintCell>
+void PrintRows(std::ostream& output, Size size, const CellStorage& cells, PrintCell print_cell) {
+    int row = 0;
+    int col = 0;
+    auto finish_row = [&] {
+        for (; col + 1 < size.cols; ++col) {
+            output << '\t';
         }
         output << '\n';
+        ++row;
+        col = 0;
+    };
+
+    cells.ForEachInRange({0, 0}, {size.rows - 1, size.cols - 1}, [&](Position pos, const Cell& cell) {
+        while (row < pos.row) {
+            finish_row();
+        }
+        for (; col < pos.col; ++col) {
+            output << '\t';
+        }
+        print_cell(cell);
+    });
+    while (row < size.rows) {
+        finish_row();
     }
 }
+
+void Sheet::PrintValues(std::ostream& output) const {
+    PrintRows(output, GetPrintableSize(), *impl_->cells_, [&output](const Cell& cell) {
+        PrintVal(output, cell.GetValueView());
+    });
+}
 void Sheet::PrintTexts(std::ostream& output) const {
-    for (int row = 0; row < impl_->size_.rows; ++row) {
-        for (int col = 0; col < impl_->size_.cols; ++col) {
-            if (col > 0) {
-                output << '\t';
-            }
-            if (auto it = impl_->FindIterator({row, col}); it != impl_->EndContents()) {
-                output << it->GetText();
-            }
-        }
-        output << '\n';
-    }
+    PrintRows(output, GetPrintableSize(), *impl_->cells_, [&output](const Cell& cell) {
+        output << cell.GetText();
+    });
+}
+
+void Sheet::ForEachInRange(Position top_left, Position bottom_right, const CellVisitor& fn) const {
+    CheckPosition(top_left);
+    CheckPosition(bottom_right);
+    impl_->cells_->ForEachInRange(top_left, bottom_right, fn);
+}
+
+void Sheet::ForEachCell(const CellVisitor& fn) const {
+    impl_->cells_->ForEach(fn);
+}
+
+SheetMemoryStats Sheet::GetMemoryStats() const {
+    const CellContext& context = impl_->context_;
+    SheetMemoryStats stats;
+    stats.cell_storage = impl_->cells_->GetStorageBytes();
+    stats.index = impl_->cells_->GetIndexBytes();
+    stats.texts = context.text_resource.GetBytesInUse();
+    stats.formulas = context.formula_resource.GetBytesInUse();
+    stats.dependencies = context.edge_resource.GetBytesInUse();
+
+    impl_->cells_->ForEach([&stats](Position, const Cell& cell) {
+        ++stats.cell_count;
+        stats.formula_cell_count += cell.IsFormula();
+        stats.empty_cell_count += cell.IsEmpty();
+    });
+    stats.value_caches = stats.formula_cell_count * Cell::GetValueCacheSize();
+    stats.referenced_empty_positions = context.pending_dependents.size();
+    stats.text_pool = context.text_pool.GetStats();
+    return stats;
+}
+
+RecalcStats Sheet::Recalculate() {
+    return impl_->context_.plan.Recalculate(*impl_->cells_, impl_->pool_.get());
 }
 
 std::unique_ptr<SheetInterface> CreateSheet() {
     return std::make_unique<Sheet>();
+}
+
+std::unique_ptr<SheetInterface> CreateSheet(SheetOptions options) {
+    return std::make_unique<Sheet>(options);
 }
\ No newline at end of file
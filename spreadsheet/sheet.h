@@ -2,16 +2,52 @@
 
 #include "common.h"
 #include "cell.h"
+#include "cell_storage.h"
 
-#include <list>
 #include <functional>
-#include <unordered_map>
-#include <iterator>
 #include <memory>
 
+struct SheetOptions {
+    CellStorageKind storage = CellStorageKind::Tiled;
+    // allocate cells, impls, formula nodes and the dependency graph from a pool
+    // owned by the sheet instead of the default memory resource
+    bool own_arena = false;
+    // threads of Recalculate, the calling one included; 1 evaluates serially
+    size_t recalc_threads = 1;
+    // a dirty formula is evaluated again only if the value of an operand or
+    // its own text changed, the rest of the dirty cells keep their values
+    bool early_cutoff = false;
+    // version stamps make writes O(1) and checks the inputs on read instead;
+    // they skip the formulas with unchanged inputs by themselves
+    CacheValidation validation = CacheValidation::PushInvalidation;
+};
+
+// Memory taken by a sheet, in bytes by component.
+struct SheetMemoryStats {
+    size_t cell_storage = 0;  // tiles / hash table and slots, the cells included
+    size_t index = 0;         // ordered index and bounding box counters
+    size_t texts = 0;         // pooled texts, short texts are inside the cells
+    size_t formulas = 0;      // formula nodes and referenced positions
+    size_t dependencies = 0;  // dependency graph and the side table
+    size_t value_caches = 0;  // cached formula values and stamps, a part of cell_storage
+
+    size_t cell_count = 0;
+    size_t formula_cell_count = 0;
+    size_t empty_cell_count = 0;
+    // positions formulas refer to that have no cell, kept in a side table
+    size_t referenced_empty_positions = 0;
+    TextPool::Stats text_pool;
+
+    size_t GetTotal() const {
+        return cell_storage + index + texts + formulas + dependencies;
+    }
+};
+
 class Sheet : public SheetInterface {
 public:
-    Sheet();
+    using CellVisitor = std::function<void(Position pos, const CellInterface& cell)>;
+
+    explicit Sheet(SheetOptions options = {});
     ~Sheet();
 
     void SetCell(Position pos, std::string text) override;
@@ -26,12 +62,26 @@ public:
     void PrintValues(std::ostream& output) const override;
     void PrintTexts(std::ostream& output) const override; 
 
+    // calls fn for every existing cell inside the rectangle in row-major
+    // order, the cost depends on the number of cells, not on the area
+    void ForEachInRange(Position top_left, Position bottom_right, const CellVisitor& fn) const;
+    void ForEachCell(const CellVisitor& fn) const;
+
+    // walks all cells to count them by kind
+    SheetMemoryStats GetMemoryStats() const;
+
+    // evaluates every formula without a cached value in one pass over the
+    // dependency order; reads afterwards find the values cached. With several
+    // recalc_threads the values are the same as with one
+    RecalcStats Recalculate();
+
 private:
-    void CheckPushSize(Position pos); // with SetCell
-    void EraseSize(Position pos); // with ClearCell
+    static void CheckPosition(Position pos); // throws InvalidPositionException
 
 private:
     struct Impl;
-    std::unique_ptr<Impl> impl_ = nullptr;
+    std::unique_ptr<Impl> impl_;
 };
 
+// creates an empty sheet with the given options
+std::unique_ptr<SheetInterface> CreateSheet(SheetOptions options);
@@ -0,0 +1,80 @@
+#include "text_pool.h"
+
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace {
+// the text header and its chars are one block
+size_t BlockSize(size_t text_size) {
+    return sizeof(TextPool::Text) + text_size;
+}
+}  // namespace
+
+TextPool::TextPool(std::pmr::memory_resource* resource)
+    : resource_(resource)
+    , texts_(resource) {
+}
+
+TextPool::~TextPool() {
+    assert(references_ == 0 && "TextPool err: texts are still referenced");
+    for (auto& [view, text] : texts_) {
+        Free(text);
+    }
+}
+
+const TextPool::Text* TextPool::Acquire(std::string_view view) {
+    ++references_;
+    referenced_bytes_ += view.size();
+    auto it = texts_.find(view);
+    if (it != texts_.end()) {
+        ++it->second->refs_;
+        return it->second;
+    }
+
+    void* block = resource_->allocate(BlockSize(view.size()), alignof(Text));
+    char* data = static_cast<char*>(block) + sizeof(Text);
+    std::memcpy(data, view.data(), view.size());
+    Text* text = new (block) Text(data, static_cast<std::uint32_t>(view.size()));
+    try {
+        texts_.emplace(text->View(), text);
+    } catch (...) {
+        resource_->deallocate(block, BlockSize(view.size()), alignof(Text));
+        --references_;
+        referenced_bytes_ -= view.size();
+        throw;
+    }
+    unique_bytes_ += view.size();
+    return text;
+}
+
+void TextPool::Release(const Text* text) {
+    // the pool owns the texts, callers only get const access
+    Text* owned = const_cast<Text*>(text);
+    assert(owned->refs_ > 0 && "TextPool::Release err: no references left");
+    --references_;
+    referenced_bytes_ -= owned->size_;
+    if (--owned->refs_ == 0) {
+        texts_.erase(owned->View());
+        unique_bytes_ -= owned->size_;
+        Free(owned);
+    }
+}
+
+void TextPool::Free(Text* text) {
+    const size_t size = text->size_;
+    text->~Text();
+    resource_->deallocate(text, BlockSize(size), alignof(Text));
+}
+
+TextPool::Stats TextPool::GetStats() const {
+    Stats stats;
+    stats.unique_texts = texts_.size();
+    stats.references = references_;
+    stats.unique_bytes = unique_bytes_;
+    stats.referenced_bytes = referenced_bytes_;
+    // a node per text plus the bucket array
+    stats.overhead_bytes = texts_.size() * (sizeof(Text) + sizeof(void*) + sizeof(std::pair<std::string_view, Text*>))
+                           + texts_.bucket_count() * sizeof(void*);
+    return stats;
+}
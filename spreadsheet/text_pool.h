@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+
+// Per-sheet pool of immutable text buffers. Identical texts share one
+// reference-counted buffer; the buffer is freed with its last reference.
+class TextPool {
+public:
+    class Text {
+    public:
+        std::string_view View() const {
+            return {data_, size_};
+        }
+
+    private:
+        friend class TextPool;
+        Text(const char* data, std::uint32_t size)
+            : data_(data)
+            , size_(size) {
+        }
+
+        const char* data_;
+        std::uint32_t size_;
+        std::uint32_t refs_ = 1;
+    };
+
+    struct Stats {
+        size_t unique_texts = 0;
+        size_t references = 0;
+        size_t unique_bytes = 0;      // chars stored once per unique text
+        size_t referenced_bytes = 0;  // chars a private copy per reference would take
+        size_t overhead_bytes = 0;    // headers and the lookup table
+    };
+
+    explicit TextPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    TextPool(const TextPool&) = delete;
+    TextPool& operator=(const TextPool&) = delete;
+    ~TextPool();
+
+    // returns the shared copy of the text with one more reference
+    const Text* Acquire(std::string_view text);
+    // drops a reference returned by Acquire
+    void Release(const Text* text);
+
+    Stats GetStats() const;
+
+private:
+    void Free(Text* text);
+
+    std::pmr::memory_resource* resource_;
+    // keys point into the pooled buffers
+    std::pmr::unordered_map<std::string_view, Text*> texts_;
+    size_t references_ = 0;
+    size_t unique_bytes_ = 0;
+    size_t referenced_bytes_ = 0;
+};
@@ -0,0 +1,104 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+
+WorkStealingPool::WorkStealingPool(size_t thread_count) {
+    assert(thread_count > 0 && "WorkStealingPool err: no threads");
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads_.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::ParallelFor(size_t count, size_t grain,
+                                   const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    const size_t task_count = (count + grain - 1) / grain;
+    {
+        std::lock_guard lock(mutex_);
+        job_ = &fn;
+        remaining_.store(task_count, std::memory_order_relaxed);
+        // contiguous runs of chunks per thread, stealing evens out the rest
+        for (size_t task = 0; task < task_count; ++task) {
+            Queue& queue = *queues_[task * queues_.size() / task_count];
+            std::lock_guard queue_lock(queue.mutex);
+            queue.tasks.push_back({task * grain, std::min(count, (task + 1) * grain)});
+        }
+        ++generation_;
+    }
+    work_ready_.notify_all();
+
+    while (RunOne(0)) {
+    }
+    std::unique_lock lock(mutex_);
+    work_done_.wait(lock, [this] {
+        return remaining_.load(std::memory_order_acquire) == 0;
+    });
+    job_ = nullptr;
+}
+
+bool WorkStealingPool::RunOne(size_t index) {
+    std::optional<Task> task;
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t k = 1; !task && k < queues_.size(); ++k) {
+        Queue& victim = *queues_[(index + k) % queues_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+
+    (*job_)(task->begin, task->end);
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard lock(mutex_);
+        work_done_.notify_all();
+    }
+    return true;
+}
+
+void WorkStealingPool::WorkerLoop(size_t index) {
+    size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            work_ready_.wait(lock, [&] {
+                return stopping_ || generation_ != seen_generation;
+            });
+            if (stopping_) {
+                return;
+            }
+            seen_generation = generation_;
+        }
+        while (RunOne(index)) {
+        }
+    }
+}
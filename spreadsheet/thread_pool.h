@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads, each with its own deque of tasks. A thread takes
+// tasks from the back of its deque and, when it runs dry, steals from the
+// front of the others. The thread calling ParallelFor works as one of them.
+class WorkStealingPool {
+public:
+    // thread_count includes the calling thread
+    explicit WorkStealingPool(size_t thread_count);
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    ~WorkStealingPool();
+
+    size_t GetThreadCount() const {
+        return queues_.size();
+    }
+
+    // calls fn(begin, end) on chunks of at most grain indexes covering
+    // [0, count), returns when all of them are done; fn must not throw
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+private:
+    struct Task {
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerLoop(size_t index);
+    // runs one task of the own deque or a stolen one, false if there is none
+    bool RunOne(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;  // [0] belongs to the calling thread
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+    const std::function<void(size_t, size_t)>* job_ = nullptr;
+    size_t generation_ = 0;  // bumped by every ParallelFor
+    bool stopping_ = false;
+    std::atomic<size_t> remaining_{0};  // tasks of the current job not finished
+};